@@ -101,7 +101,9 @@ AcquisitionController::AcquisitionController(
 
       m_btnAcquireBackgound(new QPushButton("Acquire background")),
       m_btnStartStopAcquisition(new QPushButton("Start")),
-      m_btnSaveOrDisplay(new QPushButton("Saving")), m_sbMaxFrames(new QSpinBox)
+      m_btnSaveOrDisplay(new QPushButton("Saving")),
+      m_btnSweepDisplay(new QPushButton("Sweep display")),
+      m_sbMaxFrames(new QSpinBox)
 
 {
 
@@ -213,6 +215,7 @@ AcquisitionController::AcquisitionController(
                 this->setEnabled(true);
                 m_sbMaxFrames->setEnabled(false);
                 m_btnSaveOrDisplay->setEnabled(false);
+                m_btnSweepDisplay->setEnabled(false);
 
                 m_btnStartStopAcquisition->setText("Stop");
                 m_btnStartStopAcquisition->setStyleSheet(
@@ -240,6 +243,7 @@ AcquisitionController::AcquisitionController(
               } else {
                 m_sbMaxFrames->setEnabled(true);
                 m_btnSaveOrDisplay->setEnabled(true);
+                m_btnSweepDisplay->setEnabled(true);
 
                 m_btnStartStopAcquisition->setText("Start");
                 m_btnStartStopAcquisition->setStyleSheet(
@@ -274,6 +278,23 @@ AcquisitionController::AcquisitionController(
             });
     m_btnSaveOrDisplay->setChecked(true);
   }
+
+  // Sweep display button
+  row++;
+  {
+    grid->addWidget(m_btnSweepDisplay, row, 0, 1, 2);
+    m_btnSweepDisplay->setCheckable(true);
+    m_btnSweepDisplay->setToolTip(
+        "Display each frame progressively as its A-lines are acquired");
+    connect(m_btnSweepDisplay, &QPushButton::toggled, this,
+            [this](bool checked) {
+              m_btnSweepDisplay->setStyleSheet(
+                  checked ? "background-color: green" : "");
+              m_controller.daq().setChunksPerFrame(
+                  checked ? SweepChunksPerFrame : 1);
+              Q_EMIT sigSweepDisplayToggled(checked);
+            });
+  }
 }
 
 AcquisitionController::~AcquisitionController() {
@@ -92,8 +92,14 @@ public:
     m_calib = std::move(calib);
   }
 
+  // Must be set before acquisition to use the sweep display.
+  void setChunkBuffer(std::shared_ptr<RingBuffer<OCTChunk<Float>>> buffer) {
+    m_controller.daq().setChunkBuffer(std::move(buffer));
+  }
+
 Q_SIGNALS:
   void sigUpdatedBackground();
+  void sigSweepDisplayToggled(bool enabled);
 
 protected:
   void closeEvent(QCloseEvent *event) override;
@@ -118,6 +124,10 @@ private:
   QPushButton *m_btnStartStopAcquisition;
   QPushButton *m_btnSaveOrDisplay;
 
+  // Progressive display of sub-frame chunks during acquisition
+  QPushButton *m_btnSweepDisplay;
+  static constexpr uint32_t SweepChunksPerFrame = 8;
+
   // Acquisition params
   AcquisitionParams m_acqParams;
   QSpinBox *m_sbMaxFrames;
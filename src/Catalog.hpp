@@ -0,0 +1,432 @@
+/*
+Study-level catalog of all imaging sequences under a root directory.
+
+A sequence is either a single `OCT<datetime>_<lines>.bin` file or a legacy
+directory of .dat files. Scanning only touches directory listings, file sizes
+and modification times (through `DatFileReader`), never the fringe data, and
+reuses the entries of the previous index for files whose size and mtime are
+unchanged. The mtime of a .dat directory is the newest of the directory and
+its .dat files, so files rewritten in place are picked up.
+*/
+#pragma once
+
+#include "Calibration.hpp"
+#include "Common.hpp"
+#include "FileIO.hpp"
+#include "OCTRecon.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <tbb/concurrent_vector.h>
+#include <tbb/parallel_for_each.h>
+#include <unordered_map>
+#include <vector>
+
+namespace OCT {
+
+namespace fs = std::filesystem;
+
+struct CatalogEntry {
+  enum Kind : std::uint8_t { BinFile = 0, DatDirectory };
+
+  Kind kind{BinFile};
+  fs::path path;
+  std::string seq;
+
+  size_t numFiles{};
+  size_t linesPerFrame{};
+  size_t frames{};
+  uintmax_t sizeBytes{};
+  int64_t mtime{};
+
+  // Acquisition time parsed from the file name ("YYYY-MM-DD HH:MM:SS"), or
+  // empty if the name doesn't contain one.
+  std::string timestamp;
+
+  // Thumbnail file name relative to the catalog's thumbnail directory, or
+  // empty if not generated yet.
+  std::string thumbnail;
+};
+
+namespace detail {
+
+// Parse "OCT20241019153000_2200" to "2024-10-19 15:30:00"
+inline std::string timestampFromName(const std::string &stem) {
+  static const std::regex re(
+      R"rgx(OCT(\d{4})(\d{2})(\d{2})(\d{2})(\d{2})(\d{2})_\d+)rgx");
+  std::smatch m;
+  if (std::regex_search(stem, m, re)) {
+    return fmt::format("{}-{}-{} {}:{}:{}", m[1].str(), m[2].str(), m[3].str(),
+                       m[4].str(), m[5].str(), m[6].str());
+  }
+  return {};
+}
+
+inline bool isBinFile(const fs::path &path) {
+  static const std::regex re(R"rgx(^OCT\d+_\d+$)rgx");
+  return path.extension() == ".bin" &&
+         std::regex_match(path.stem().string(), re);
+}
+
+inline int64_t mtimeOf(const fs::path &path) {
+  return fs::last_write_time(path).time_since_epoch().count();
+}
+
+} // namespace detail
+
+class Catalog {
+public:
+  static constexpr const char *indexFileName = "index.tsv";
+  static constexpr const char *indexHeader = "# OCTGui catalog v1";
+
+  Catalog() = default;
+  Catalog(fs::path root, fs::path indexDir)
+      : m_root(std::move(root)), m_indexDir(std::move(indexDir)) {}
+
+  [[nodiscard]] const auto &root() const { return m_root; }
+  [[nodiscard]] const auto &entries() const { return m_entries; }
+  [[nodiscard]] fs::path indexPath() const {
+    return m_indexDir / indexFileName;
+  }
+  [[nodiscard]] fs::path thumbnailDir() const {
+    return m_indexDir / "thumbnails";
+  }
+
+  // Load the persisted index. Returns an error message on failure.
+  [[nodiscard]] std::optional<std::string> loadIndex() {
+    std::ifstream ifs(indexPath());
+    if (!ifs.is_open()) {
+      return fmt::format("No catalog index at {}", indexPath().string());
+    }
+
+    std::string line;
+    if (!std::getline(ifs, line) || line != indexHeader) {
+      return fmt::format("Unknown catalog index format in {}",
+                         indexPath().string());
+    }
+
+    std::vector<CatalogEntry> entries;
+    while (std::getline(ifs, line)) {
+      if (auto entry = parseEntry(line)) {
+        entries.push_back(std::move(*entry));
+      }
+    }
+    m_entries = std::move(entries);
+    return std::nullopt;
+  }
+
+  // Persist the index. Returns an error message on failure.
+  [[nodiscard]] std::optional<std::string> saveIndex() const {
+    std::error_code ec;
+    fs::create_directories(m_indexDir, ec);
+
+    // Write to a temporary file first so a crash never leaves a truncated
+    // index behind.
+    const auto tmpPath = fs::path(indexPath()).concat(".tmp");
+    {
+      std::ofstream ofs(tmpPath);
+      if (!ofs.is_open()) {
+        return fmt::format("Failed to write catalog index {}",
+                           tmpPath.string());
+      }
+      ofs << indexHeader << '\n';
+      for (const auto &e : m_entries) {
+        ofs << static_cast<int>(e.kind) << '\t' << e.path.string() << '\t'
+            << e.seq << '\t' << e.numFiles << '\t' << e.linesPerFrame << '\t'
+            << e.frames << '\t' << e.sizeBytes << '\t' << e.mtime << '\t'
+            << e.timestamp << '\t' << e.thumbnail << '\n';
+      }
+      if (!ofs) {
+        return fmt::format("Failed to write catalog index {}",
+                           tmpPath.string());
+      }
+    }
+
+    fs::rename(tmpPath, indexPath(), ec);
+    if (ec) {
+      return fmt::format("Failed to write catalog index {}: {}",
+                         indexPath().string(), ec.message());
+    }
+    return std::nullopt;
+  }
+
+  /**
+  Walk `root` in parallel and update the entries.
+
+  Files and directories whose size and mtime match the current index are
+  reused without touching them further. Sequences that no longer exist are
+  dropped.
+
+  The walk stops early once `cancel` is set. Returns false, leaving the
+  entries unchanged, if it was cancelled.
+   */
+  [[nodiscard]] bool scan(const std::atomic<bool> *cancel = nullptr) {
+    const auto cancelled = [cancel]() {
+      return cancel != nullptr && cancel->load();
+    };
+
+    std::unordered_map<std::string, const CatalogEntry *> previous;
+    for (const auto &e : m_entries) {
+      previous.emplace(e.path.string(), &e);
+    }
+
+    const auto findUnchanged = [&](const fs::path &path,
+                                   std::optional<uintmax_t> sizeBytes,
+                                   int64_t mtime) -> const CatalogEntry * {
+      const auto it = previous.find(path.string());
+      if (it != previous.end() && it->second->mtime == mtime &&
+          (!sizeBytes || it->second->sizeBytes == *sizeBytes)) {
+        return it->second;
+      }
+      return nullptr;
+    };
+
+    tbb::concurrent_vector<CatalogEntry> found;
+    std::atomic<size_t> reused{0};
+
+    const auto visitDir = [&](const fs::path &dir,
+                              tbb::feeder<fs::path> &feeder) {
+      if (cancelled()) {
+        return;
+      }
+
+      try {
+        bool hasDat = false;
+        // file_clock counts may be negative
+        int64_t datMtime = std::numeric_limits<int64_t>::min();
+        for (const auto &entry : fs::directory_iterator(dir)) {
+          if (cancelled()) {
+            return;
+          }
+
+          const auto &path = entry.path();
+          if (entry.is_symlink()) {
+            // Don't follow links to avoid cycles and double counting
+            continue;
+          }
+
+          if (entry.is_directory()) {
+            feeder.add(path);
+          } else if (entry.is_regular_file()) {
+            if (path.extension() == ".dat") {
+              hasDat = true;
+              datMtime = std::max<int64_t>(
+                  datMtime, entry.last_write_time().time_since_epoch().count());
+            } else if (detail::isBinFile(path)) {
+              const auto sizeBytes = entry.file_size();
+              const auto mtime =
+                  entry.last_write_time().time_since_epoch().count();
+              if (const auto *e = findUnchanged(path, sizeBytes, mtime)) {
+                found.push_back(*e);
+                ++reused;
+              } else if (auto newEntry =
+                             makeBinEntry(path, sizeBytes, mtime)) {
+                found.push_back(std::move(*newEntry));
+              }
+            }
+          }
+        }
+
+        if (hasDat) {
+          // Adding or removing .dat files updates the directory mtime, and
+          // rewriting one in place updates its own mtime.
+          const auto mtime = std::max(detail::mtimeOf(dir), datMtime);
+          if (const auto *e = findUnchanged(dir, std::nullopt, mtime)) {
+            found.push_back(*e);
+            ++reused;
+          } else if (auto newEntry = makeDatEntry(dir, mtime)) {
+            found.push_back(std::move(*newEntry));
+          }
+        }
+
+      } catch (const fs::filesystem_error &e) {
+        std::cerr << "Filesystem error: " << e.what() << '\n';
+      } catch (const std::exception &e) {
+        // e.g. a malformed file name. Skip the rest of this directory rather
+        // than terminating the scan thread.
+        std::cerr << "Error scanning " << dir << ": " << e.what() << '\n';
+      }
+    };
+
+    const std::vector<fs::path> roots{m_root};
+    tbb::parallel_for_each(roots.begin(), roots.end(), visitDir);
+    if (cancelled()) {
+      return false;
+    }
+
+    m_entries.assign(found.begin(), found.end());
+    m_reused = reused;
+    std::ranges::sort(m_entries, [](const auto &a, const auto &b) {
+      return a.path < b.path;
+    });
+    return true;
+  }
+
+  // Number of entries reused from the index by the last `scan`
+  [[nodiscard]] size_t reused() const { return m_reused; }
+
+  // Set the thumbnail of the entry at `path` (if it is in the catalog).
+  void setThumbnail(const fs::path &path, const std::string &thumbnail) {
+    for (auto &e : m_entries) {
+      if (e.path == path) {
+        e.thumbnail = thumbnail;
+      }
+    }
+  }
+
+  // Deterministic thumbnail file name for a sequence. Changes when the
+  // sequence is modified.
+  [[nodiscard]] static std::string thumbnailName(const CatalogEntry &entry) {
+    return fmt::format("{:016x}-{:016x}.png",
+                       std::hash<std::string>{}(entry.path.string()),
+                       static_cast<uint64_t>(entry.mtime));
+  }
+
+  /**
+  Reconstruct the first frame of `entry` and write a small radial image to
+  `thumbnailDir`. This reads one frame of fringe data, so it is done on demand
+  instead of during `scan`.
+  Returns the thumbnail file name, or nullopt on failure.
+   */
+  [[nodiscard]] static std::optional<std::string>
+  makeThumbnail(const CatalogEntry &entry, const Calibration<Float> &calib,
+                const fs::path &thumbnailDir, int size = 160) {
+    const auto reader = openReader(entry.kind, entry.path);
+    if (!reader) {
+      return std::nullopt;
+    }
+
+    fftconv::AlignedVector<uint16_t> fringe(reader->samplesPerFrame());
+    if (const auto err = reader->read(0, 1, fringe)) {
+      std::cerr << "While making thumbnail for " << entry.path << ", got "
+                << *err << '\n';
+      return std::nullopt;
+    }
+
+    const OCTReconParams<Float> params{};
+    cv::Mat_<Float> mat;
+    reconLogMagnitude<Float>(calib, fringe, DatFileReader::ALineSize, params,
+                             mat);
+    cv::Mat_<uint8_t> rect;
+    cv::Mat_<Float>(mat.t()).convertTo(rect, CV_8U);
+
+    cv::Mat_<uint8_t> radial;
+    makeRadialImage(rect, radial, params.padTop);
+    cv::resize(radial, radial, {size, size}, 0, 0, cv::INTER_AREA);
+
+    std::error_code ec;
+    fs::create_directories(thumbnailDir, ec);
+    auto name = thumbnailName(entry);
+    if (!cv::imwrite((thumbnailDir / name).string(), radial)) {
+      return std::nullopt;
+    }
+    return name;
+  }
+
+private:
+  fs::path m_root;
+  fs::path m_indexDir;
+  std::vector<CatalogEntry> m_entries;
+  size_t m_reused{};
+
+  // The reader throws on some malformed names, which shouldn't stop a scan.
+  static std::optional<DatFileReader> openReader(CatalogEntry::Kind kind,
+                                                 const fs::path &path) {
+    try {
+      auto reader = kind == CatalogEntry::BinFile
+                        ? DatFileReader::readBinFile(path)
+                        : DatFileReader::readDatDirectory(path);
+      if (reader.ok()) {
+        return reader;
+      }
+    } catch (const std::exception &e) {
+      std::cerr << "Skipping " << path << ": " << e.what() << '\n';
+    }
+    return std::nullopt;
+  }
+
+  static std::optional<CatalogEntry>
+  makeBinEntry(const fs::path &path, uintmax_t sizeBytes, int64_t mtime) {
+    const auto reader = openReader(CatalogEntry::BinFile, path);
+    if (!reader) {
+      return std::nullopt;
+    }
+
+    CatalogEntry e;
+    e.kind = CatalogEntry::BinFile;
+    e.path = path;
+    e.seq = reader->seq();
+    e.numFiles = reader->numFiles();
+    e.linesPerFrame = reader->linesPerFrame();
+    e.frames = reader->size();
+    e.sizeBytes = sizeBytes;
+    e.mtime = mtime;
+    e.timestamp = detail::timestampFromName(path.stem().string());
+    return e;
+  }
+
+  static std::optional<CatalogEntry> makeDatEntry(const fs::path &dir,
+                                                  int64_t mtime) {
+    const auto reader = openReader(CatalogEntry::DatDirectory, dir);
+    if (!reader) {
+      return std::nullopt;
+    }
+
+    CatalogEntry e;
+    e.kind = CatalogEntry::DatDirectory;
+    e.path = dir;
+    e.seq = reader->seq();
+    e.numFiles = reader->numFiles();
+    e.linesPerFrame = reader->linesPerFrame();
+    e.frames = reader->size();
+    e.sizeBytes = reader->size() * reader->frameSizeBytes();
+    e.mtime = mtime;
+    e.timestamp = detail::timestampFromName(getDirectoryName(dir));
+    return e;
+  }
+
+  static std::optional<CatalogEntry> parseEntry(const std::string &line) {
+    std::vector<std::string> fields;
+    std::string field;
+    std::istringstream iss(line);
+    while (std::getline(iss, field, '\t')) {
+      fields.push_back(field);
+    }
+    // A trailing empty thumbnail field is dropped by getline
+    if (fields.size() == 9) {
+      fields.emplace_back();
+    }
+    if (fields.size() != 10) {
+      return std::nullopt;
+    }
+
+    try {
+      CatalogEntry e;
+      e.kind = static_cast<CatalogEntry::Kind>(std::stoi(fields[0]));
+      e.path = fields[1];
+      e.seq = fields[2];
+      e.numFiles = std::stoull(fields[3]);
+      e.linesPerFrame = std::stoull(fields[4]);
+      e.frames = std::stoull(fields[5]);
+      e.sizeBytes = std::stoull(fields[6]);
+      e.mtime = std::stoll(fields[7]);
+      e.timestamp = fields[8];
+      e.thumbnail = fields[9];
+      return e;
+    } catch (const std::exception &) {
+      return std::nullopt;
+    }
+  }
+};
+
+} // namespace OCT
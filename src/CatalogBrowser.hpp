@@ -0,0 +1,405 @@
+#pragma once
+
+#include "Calibration.hpp"
+#include "Catalog.hpp"
+#include "Common.hpp"
+#include "strOps.hpp"
+#include "timeit.hpp"
+#include <QFileDialog>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPixmap>
+#include <QPushButton>
+#include <QSortFilterProxyModel>
+#include <QStandardItemModel>
+#include <QStandardPaths>
+#include <QTableView>
+#include <QThread>
+#include <QVBoxLayout>
+#include <QWidget>
+#include <atomic>
+#include <cassert>
+#include <fmt/format.h>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace OCT {
+
+/**
+Searchable browser for a `Catalog`.
+
+The persisted index is shown immediately, then the root is rescanned in a
+background thread and the table is refreshed with the result.
+Thumbnails are generated on demand when a sequence is selected.
+ */
+class CatalogBrowser : public QWidget {
+  Q_OBJECT
+
+public:
+  enum Column : std::uint8_t {
+    ColName = 0,
+    ColTimestamp,
+    ColLines,
+    ColFrames,
+    ColSize,
+    ColPath,
+    ColCount
+  };
+
+  explicit CatalogBrowser(QWidget *parent = nullptr)
+      : QWidget(parent), m_model(new QStandardItemModel(0, ColCount, this)),
+        m_proxy(new QSortFilterProxyModel(this)), m_table(new QTableView),
+        m_search(new QLineEdit), m_rootLabel(new QLabel),
+        m_statusLabel(new QLabel), m_thumbnail(new QLabel),
+        m_btnRoot(new QPushButton("Root...")),
+        m_btnRescan(new QPushButton("Rescan")) {
+
+    m_model->setHorizontalHeaderLabels(
+        {"Sequence", "Timestamp", "Lines", "Frames", "Size (GB)", "Path"});
+    m_proxy->setSourceModel(m_model);
+    m_proxy->setFilterCaseSensitivity(Qt::CaseInsensitive);
+    m_proxy->setFilterKeyColumn(-1); // Search all columns
+
+    m_table->setModel(m_proxy);
+    m_table->setSortingEnabled(true);
+    m_table->sortByColumn(ColTimestamp, Qt::DescendingOrder);
+    m_table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_table->setSelectionMode(QAbstractItemView::SingleSelection);
+    m_table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_table->verticalHeader()->hide();
+    m_table->horizontalHeader()->setStretchLastSection(true);
+
+    constexpr int thumbnailSize = 160;
+    m_thumbnail->setFixedSize(thumbnailSize, thumbnailSize);
+    m_thumbnail->setAlignment(Qt::AlignCenter);
+
+    m_search->setPlaceholderText("Search sequences");
+    m_search->setClearButtonEnabled(true);
+
+    // GUI
+    // ---
+    auto *layout = new QHBoxLayout;
+    setLayout(layout);
+
+    auto *left = new QVBoxLayout;
+    layout->addLayout(left);
+    {
+      auto *row = new QHBoxLayout;
+      row->addWidget(m_search);
+      row->addWidget(m_btnRoot);
+      row->addWidget(m_btnRescan);
+      left->addLayout(row);
+    }
+    left->addWidget(m_table);
+    {
+      auto *row = new QHBoxLayout;
+      row->addWidget(m_rootLabel);
+      row->addStretch();
+      row->addWidget(m_statusLabel);
+      left->addLayout(row);
+    }
+    layout->addWidget(m_thumbnail, 0, Qt::AlignTop);
+
+    // Bind
+    // ----
+    connect(m_search, &QLineEdit::textChanged, m_proxy,
+            &QSortFilterProxyModel::setFilterFixedString);
+
+    connect(m_btnRoot, &QPushButton::clicked, this, [this]() {
+      const QString dir = QFileDialog::getExistingDirectory(
+          this, "Select catalog root directory", toQString(m_catalog.root()));
+      if (!dir.isEmpty()) {
+        setRoot(dir);
+      }
+    });
+
+    connect(m_btnRescan, &QPushButton::clicked, this,
+            &CatalogBrowser::rescan);
+
+    connect(m_table, &QTableView::doubleClicked, this,
+            [this](const QModelIndex &index) {
+              if (const auto *e = entryAt(index)) {
+                Q_EMIT openRequested(toQString(e->path),
+                                     e->kind == CatalogEntry::DatDirectory);
+              }
+            });
+
+    connect(m_table->selectionModel(), &QItemSelectionModel::currentRowChanged,
+            this, [this](const QModelIndex &current) {
+              if (const auto *e = entryAt(current)) {
+                showThumbnail(*e);
+              }
+            });
+  }
+
+  CatalogBrowser(const CatalogBrowser &) = delete;
+  CatalogBrowser(CatalogBrowser &&) = delete;
+  CatalogBrowser &operator=(const CatalogBrowser &) = delete;
+  CatalogBrowser &operator=(CatalogBrowser &&) = delete;
+
+  ~CatalogBrowser() override {
+    // Don't wait for the full walk of a large root on exit. The result of a
+    // running scan is never applied, and a scan that completes anyway writes
+    // its own index.
+    const bool scanning = isBusy();
+    m_cancelScan = true;
+    for (auto *thread : {m_scanThread, m_thumbnailThread}) {
+      if (thread != nullptr) {
+        thread->wait();
+      }
+    }
+    if (!scanning) {
+      saveNewThumbnails();
+    }
+  }
+
+public Q_SLOTS:
+  void setCalibration(std::shared_ptr<Calibration<Float>> calib) {
+    m_calib = std::move(calib);
+  }
+
+  // Show the persisted index of `qroot` (if any), then rescan it. A running
+  // scan is cancelled first.
+  void setRoot(const QString &qroot) {
+    if (isBusy()) {
+      m_pendingRoot = qroot;
+      m_cancelScan = true;
+      return;
+    }
+
+    saveNewThumbnails();
+
+    const auto root = toPath(qroot);
+    m_catalog = Catalog(root, indexDirFor(root));
+    m_rootLabel->setText(qroot);
+
+    TimeIt timeit;
+    if (const auto err = m_catalog.loadIndex(); !err) {
+      updateModel();
+      const auto msg =
+          fmt::format("Loaded index in {:.0f} ms", timeit.get_ms());
+      m_statusLabel->setText(QString::fromStdString(msg));
+    }
+
+    rescan();
+  }
+
+  // Incrementally rescan the root in a background thread.
+  void rescan() {
+    if (isBusy() || m_catalog.root().empty()) {
+      return;
+    }
+
+    m_btnRescan->setEnabled(false);
+    m_btnRoot->setEnabled(false);
+    m_statusLabel->setText("Scanning...");
+
+    // The scan works on a copy so the GUI keeps showing the old index. The
+    // copy has all thumbnails made so far, and the scan thread writes it.
+    auto catalog = std::make_shared<Catalog>(m_catalog);
+    m_newThumbnails.clear();
+    m_cancelScan = false;
+    m_scanThread = QThread::create([this, catalog]() {
+      TimeIt timeit;
+      if (!catalog->scan(&m_cancelScan)) {
+        QMetaObject::invokeMethod(
+            this,
+            [this]() {
+              m_statusLabel->setText("Scan cancelled");
+              m_btnRescan->setEnabled(true);
+              m_btnRoot->setEnabled(true);
+            },
+            Qt::QueuedConnection);
+        return;
+      }
+      const auto err = catalog->saveIndex();
+      const auto msg = fmt::format(
+          "{} sequences ({} unchanged) in {:.1f} s{}",
+          catalog->entries().size(), catalog->reused(), timeit.get_ms() * 1e-3,
+          err ? " (" + *err + ")" : std::string{});
+
+      QMetaObject::invokeMethod(
+          this,
+          [this, catalog, msg]() {
+            m_catalog = *catalog;
+            // Thumbnails made during the scan
+            for (const auto &[path, name] : m_newThumbnails) {
+              m_catalog.setThumbnail(path, name);
+            }
+            updateModel();
+            m_statusLabel->setText(QString::fromStdString(msg));
+            m_btnRescan->setEnabled(true);
+            m_btnRoot->setEnabled(true);
+          },
+          Qt::QueuedConnection);
+    });
+    connect(m_scanThread, &QThread::finished, m_scanThread,
+            &QObject::deleteLater);
+    connect(m_scanThread, &QThread::finished, this, [this]() {
+      m_scanThread = nullptr;
+      if (m_pendingRoot) {
+        setRoot(*std::exchange(m_pendingRoot, std::nullopt));
+      }
+    });
+    m_scanThread->start();
+  }
+
+Q_SIGNALS:
+  // A sequence was double clicked. `isDatDirectory` is false for bin files.
+  void openRequested(QString path, bool isDatDirectory);
+
+private:
+  Catalog m_catalog;
+  std::shared_ptr<Calibration<Float>> m_calib;
+
+  QStandardItemModel *m_model;
+  QSortFilterProxyModel *m_proxy;
+  QTableView *m_table;
+  QLineEdit *m_search;
+  QLabel *m_rootLabel;
+  QLabel *m_statusLabel;
+  QLabel *m_thumbnail;
+  QPushButton *m_btnRoot;
+  QPushButton *m_btnRescan;
+
+  QThread *m_scanThread{};
+  QThread *m_thumbnailThread{};
+  std::atomic<bool> m_cancelScan{false};
+  // Root set while a scan was running, applied when it stops
+  std::optional<QString> m_pendingRoot;
+
+  // Thumbnails made since the index was last written, as (path, name). The
+  // index is only written by the scan thread, or by `saveNewThumbnails` when
+  // no scan is running.
+  std::vector<std::pair<fs::path, std::string>> m_newThumbnails;
+
+  [[nodiscard]] bool isBusy() const { return m_scanThread != nullptr; }
+
+  // Write the index if thumbnails were made since it was last written. Must
+  // not be called while a scan is running.
+  void saveNewThumbnails() {
+    assert(!isBusy());
+    if (m_newThumbnails.empty()) {
+      return;
+    }
+    if (const auto err = m_catalog.saveIndex()) {
+      std::cerr << *err << '\n';
+    }
+    m_newThumbnails.clear();
+  }
+
+  // The index is kept out of the (possibly read-only) data drive, one
+  // directory per root.
+  static fs::path indexDirFor(const fs::path &root) {
+    const auto appData = toPath(QStandardPaths::writableLocation(
+        QStandardPaths::AppLocalDataLocation));
+    const auto rootHash =
+        std::hash<std::string>{}(root.lexically_normal().string());
+    return appData / "catalog" / fmt::format("{:016x}", rootHash);
+  }
+
+  // Model row -> catalog entry
+  [[nodiscard]] const CatalogEntry *entryAt(const QModelIndex &proxyIndex) {
+    if (!proxyIndex.isValid()) {
+      return nullptr;
+    }
+    const auto row = m_proxy->mapToSource(proxyIndex).row();
+    const auto i =
+        m_model->item(row, ColName)->data(Qt::UserRole).toULongLong();
+    const auto &entries = m_catalog.entries();
+    return i < entries.size() ? &entries[i] : nullptr;
+  }
+
+  void updateModel() {
+    m_table->setSortingEnabled(false);
+    m_model->removeRows(0, m_model->rowCount());
+
+    const auto &entries = m_catalog.entries();
+    for (size_t i = 0; i < entries.size(); ++i) {
+      const auto &e = entries[i];
+
+      auto *name = new QStandardItem(QString::fromStdString(e.seq));
+      name->setData(static_cast<qulonglong>(i), Qt::UserRole);
+
+      auto *lines = new QStandardItem;
+      lines->setData(static_cast<qulonglong>(e.linesPerFrame),
+                     Qt::DisplayRole);
+      auto *frames = new QStandardItem;
+      frames->setData(static_cast<qulonglong>(e.frames), Qt::DisplayRole);
+      auto *size = new QStandardItem;
+      constexpr double bytesToGB = 1e-9;
+      size->setData(static_cast<double>(e.sizeBytes) * bytesToGB,
+                    Qt::DisplayRole);
+
+      auto *timestamp = new QStandardItem(QString::fromStdString(e.timestamp));
+      auto *path = new QStandardItem(toQString(e.path));
+
+      m_model->appendRow({name, timestamp, lines, frames, size, path});
+    }
+
+    m_table->setSortingEnabled(true);
+    m_table->resizeColumnsToContents();
+  }
+
+  void showThumbnail(const CatalogEntry &entry) {
+    // The thumbnail name is deterministic, so a thumbnail made while a scan
+    // was running (and not recorded in its result) is still found.
+    const auto path =
+        m_catalog.thumbnailDir() / (entry.thumbnail.empty()
+                                        ? Catalog::thumbnailName(entry)
+                                        : entry.thumbnail);
+    if (fs::exists(path)) {
+      m_thumbnail->setPixmap(QPixmap(toQString(path)));
+      return;
+    }
+
+    m_thumbnail->setPixmap({});
+    if (m_calib == nullptr) {
+      m_thumbnail->setText("No calibration\nfor thumbnail");
+      return;
+    }
+    if (m_thumbnailThread != nullptr) {
+      m_thumbnail->setText("...");
+      return;
+    }
+
+    // Reconstructing the thumbnail reads one frame, do it in the background.
+    m_thumbnail->setText("Loading...");
+    m_thumbnailThread = QThread::create(
+        [this, entry, calib = m_calib, dir = m_catalog.thumbnailDir()]() {
+          std::optional<std::string> name;
+          try {
+            name = Catalog::makeThumbnail(entry, *calib, dir);
+          } catch (const std::exception &e) {
+            std::cerr << "While making thumbnail for " << entry.path
+                      << ", got " << e.what() << '\n';
+          }
+          QMetaObject::invokeMethod(
+              this,
+              [this, entry, name]() {
+                if (!name) {
+                  m_thumbnail->setText("No thumbnail");
+                  return;
+                }
+                m_catalog.setThumbnail(entry.path, *name);
+                m_newThumbnails.emplace_back(entry.path, *name);
+                m_thumbnail->setPixmap(
+                    QPixmap(toQString(m_catalog.thumbnailDir() / *name)));
+              },
+              Qt::QueuedConnection);
+        });
+    connect(m_thumbnailThread, &QThread::finished, m_thumbnailThread,
+            &QObject::deleteLater);
+    connect(m_thumbnailThread, &QThread::finished, this,
+            [this]() { m_thumbnailThread = nullptr; });
+    m_thumbnailThread->start();
+  }
+};
+
+} // namespace OCT
@@ -406,6 +406,12 @@ bool DAQ::initHardware() noexcept {
 bool DAQ::prepareAcquisition(int maxBuffersToAcquire) noexcept {
   m_errMsg.clear();
 
+  if (m_chunksPerFrame == 0 || recordsPerBuffer % m_chunksPerFrame != 0) {
+    m_errMsg = fmt::format("{} chunks per frame doesn't divide {} A-lines",
+                           m_chunksPerFrame, recordsPerBuffer);
+    return false;
+  }
+
   if (m_saveData) {
     const auto fname =
         fmt::format("OCT{}_{}.bin", datetime::datetimeFormat("%Y%m%d%H%M%S"),
@@ -438,7 +444,8 @@ bool DAQ::prepareAcquisition(int maxBuffersToAcquire) noexcept {
 
   const auto bytesPerSample = (float)((bitsPerSample + 7) / 8);
   const U32 bytesPerRecord = (U32)(bytesPerSample * recordSize + 0.5);
-  const U32 bytesPerBuffer = bytesPerRecord * recordsPerBuffer * channelCount;
+  const U32 recordsPerChunk = recordsPerBuffer / m_chunksPerFrame;
+  const U32 bytesPerBuffer = bytesPerRecord * recordsPerChunk * channelCount;
 
   // Free all memory allocated
   for (auto &buf : buffers) {
@@ -447,6 +454,11 @@ bool DAQ::prepareAcquisition(int maxBuffersToAcquire) noexcept {
       buf = {};
     }
   }
+  buffers.resize(num_frame_buffers * m_chunksPerFrame);
+
+  if (m_chunksPerFrame > 1) {
+    m_frame.resize(static_cast<size_t>(recordSize) * recordsPerBuffer);
+  }
 
   for (auto &buf : buffers) {
     // Allocate page aligned memory
@@ -475,12 +487,18 @@ bool DAQ::acquire(int buffersToAcquire,
   RETURN_CODE ret{ApiSuccess};
   bool success{true};
 
+  // Each frame (`recordsPerBuffer` A-lines) is split into `chunksPerFrame`
+  // DMA buffers.
+  const uint32_t chunksPerFrame = m_chunksPerFrame;
+  const U32 recordsPerChunk = recordsPerBuffer / chunksPerFrame;
+  const uint32_t chunksToAcquire = buffersToAcquire * chunksPerFrame;
+
   // Configure the board to make an NPT AutoDMA acquisition
   U32 recordsPerAcquisition = recordsPerBuffer * buffersToAcquire;
   U32 admaFlags =
       ADMA_EXTERNAL_STARTCAPTURE | ADMA_NPT | ADMA_FIFO_ONLY_STREAMING;
   ALAZAR_CALL(AlazarBeforeAsyncRead(board, channelMask, 0, recordSize,
-                                    recordsPerBuffer, recordsPerAcquisition,
+                                    recordsPerChunk, recordsPerAcquisition,
                                     admaFlags));
   RETURN_BOOL_IF_FAIL();
 
@@ -502,8 +520,11 @@ bool DAQ::acquire(int buffersToAcquire,
 
   uint32_t buffersCompleted = 0;
   uint32_t bufferIdx = 0;
+  // Sum of chunk arrival times since the start of the current frame
+  TimeIt::clock::duration chunkTimeSum{};
+  const auto t0 = TimeIt::clock::now();
   while (success && !shouldStopAcquiring &&
-         buffersCompleted < buffersToAcquire) {
+         buffersCompleted < chunksToAcquire) {
     if (callback) {
       callback();
     }
@@ -521,17 +542,64 @@ bool DAQ::acquire(int buffersToAcquire,
       success = true;
       buffersCompleted++;
 
-      m_ringBuffer->produce_nolock(
-          [&, this](std::shared_ptr<OCTData<Float>> &dat) {
-            dat->i = buffersCompleted - 1;
-
-            // Copy data from alazar buffer to ring buffer
-            auto &fringe = dat->fringe;
-            if (fringe.size() < buf.size()) {
-              fringe.resize(buf.size());
-            }
-            std::copy(buf.data(), buf.data() + buf.size(), fringe.data());
-          });
+      const auto now = TimeIt::clock::now();
+      const auto frameIdx = (buffersCompleted - 1) / chunksPerFrame;
+      const auto chunkIdx = (buffersCompleted - 1) % chunksPerFrame;
+
+      if (chunksPerFrame == 1) {
+        m_ringBuffer->produce_nolock(
+            [&, this](std::shared_ptr<OCTData<Float>> &dat) {
+              dat->i = frameIdx;
+              dat->acquiredAt = now;
+
+              // Copy data from alazar buffer to ring buffer
+              auto &fringe = dat->fringe;
+              if (fringe.size() < buf.size()) {
+                fringe.resize(buf.size());
+              }
+              std::copy(buf.data(), buf.data() + buf.size(), fringe.data());
+            });
+      } else {
+        // Assemble the frame
+        std::copy(buf.data(), buf.data() + buf.size(),
+                  m_frame.data() + chunkIdx * buf.size());
+        chunkTimeSum += now - t0;
+
+        // The sweep worker consumes every chunk in order with `consume`,
+        // which updates the ring buffer state, so produce under its lock.
+        if (m_chunkBuffer) {
+          m_chunkBuffer->produce(
+              [&](std::shared_ptr<OCTChunk<Float>> &chunk) {
+                chunk->frameIdx = frameIdx;
+                chunk->chunkIdx = chunkIdx;
+                chunk->chunksPerFrame = chunksPerFrame;
+                chunk->linesPerFrame = recordsPerBuffer;
+                chunk->acquiredAt = now;
+
+                auto &fringe = chunk->fringe;
+                if (fringe.size() != buf.size()) {
+                  fringe.resize(buf.size());
+                }
+                std::copy(buf.data(), buf.data() + buf.size(), fringe.data());
+              });
+        }
+
+        if (chunkIdx + 1 == chunksPerFrame) {
+          m_ringBuffer->produce_nolock(
+              [&, this](std::shared_ptr<OCTData<Float>> &dat) {
+                dat->i = frameIdx;
+                dat->acquiredAt = t0 + chunkTimeSum / chunksPerFrame;
+
+                // Swap the assembled frame into the ring buffer. The slot's
+                // old buffer is reused for the next frame.
+                std::swap(dat->fringe, m_frame);
+                if (m_frame.size() != dat->fringe.size()) {
+                  m_frame.resize(dat->fringe.size());
+                }
+              });
+          chunkTimeSum = {};
+        }
+      }
 
       // Save
       if (m_fs.is_open()) {
@@ -15,6 +15,7 @@ Implements a data acquisition interface
 #include <memory>
 #include <span>
 #include <string>
+#include <vector>
 
 namespace OCT::daq {
 
@@ -52,6 +53,21 @@ public:
 
   void setShouldStopAcquiring() { shouldStopAcquiring = true; }
 
+  // Split each frame into `n` DMA buffers ("chunks"). Every completed chunk is
+  // also produced to the chunk buffer for progressive display, and the full
+  // frame is produced to the frame buffer after its last chunk. `n` must
+  // divide the A-lines per frame. Takes effect on the next
+  // `prepareAcquisition`.
+  void setChunksPerFrame(uint32_t n) noexcept { m_chunksPerFrame = n; }
+  [[nodiscard]] uint32_t chunksPerFrame() const noexcept {
+    return m_chunksPerFrame;
+  }
+
+  // Ring buffer for sub-frame chunks . Chunks are only produced if set.
+  void setChunkBuffer(std::shared_ptr<RingBuffer<OCTChunk<Float>>> buffer) {
+    m_chunkBuffer = std::move(buffer);
+  }
+
   void setSaveData(bool save) noexcept { m_saveData = save; }
   bool isSavingData() const noexcept { return m_saveData; }
   void setSaveDir(fs::path savedir) noexcept { m_savedir = std::move(savedir); }
@@ -61,6 +77,7 @@ public:
 private:
   // Ring buffer
   std::shared_ptr<RingBuffer<OCTData<Float>>> m_ringBuffer;
+  std::shared_ptr<RingBuffer<OCTChunk<Float>>> m_chunkBuffer;
 
   // Control states
   std::atomic<bool> shouldStopAcquiring{false};
@@ -69,14 +86,21 @@ private:
   // Alazar board handle
   void *board{};
 
-  // Alazar buffers
-  static constexpr size_t num_buffers{16};
-  std::array<std::span<uint16_t>, num_buffers> buffers{};
+  // Alazar buffers. The same number of frames is buffered regardless of
+  // `m_chunksPerFrame`, so there are `num_frame_buffers * m_chunksPerFrame`
+  // DMA buffers.
+  static constexpr size_t num_frame_buffers{16};
+  std::vector<std::span<uint16_t>> buffers;
 
   uint32_t recordSize = 3 * 2048;   // ALine size
   uint32_t recordsPerBuffer = 2200; // ALines per BScan
   uint32_t channelMask{};
 
+  // Sub-frame chunks
+  uint32_t m_chunksPerFrame{1};
+  // Frame assembled from chunks, swapped into the ring buffer when complete
+  fftconv::AlignedVector<uint16_t> m_frame;
+
   // Sampling rate
   double samplesPerSec = 0.0;
 
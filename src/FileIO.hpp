@@ -142,6 +142,9 @@ struct DatFileReader {
   // Get the number of frames available.
   [[nodiscard]] size_t size() const { return m_files.size() * m_framesPerFile; }
 
+  [[nodiscard]] size_t linesPerFrame() const { return m_linesPerFrame; }
+  [[nodiscard]] size_t numFiles() const { return m_files.size(); }
+
   [[nodiscard]] size_t samplesPerFrame() const {
     return m_linesPerFrame * ALineSize;
   }
@@ -206,6 +209,12 @@ private:
           m_linesPerFrame = linesPerFrame;
         }
 
+        if (m_linesPerFrame == 0) {
+          std::cerr << "Unknown frame size: " << totalLines
+                    << " A lines, not divisible by 2200 or 2500.\n";
+          return;
+        }
+
         m_framesPerFile = totalLines / m_linesPerFrame;
         // NOLINTEND(*-magic-numbers)
       } else {
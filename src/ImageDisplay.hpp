@@ -5,6 +5,7 @@
 #include <QEvent>
 #include <QGestureEvent>
 #include <QGraphicsItem>
+#include <QGraphicsPixmapItem>
 #include <QGraphicsScene>
 #include <QGraphicsSceneEvent>
 #include <QGraphicsSceneWheelEvent>
@@ -82,6 +83,24 @@ public Q_SLOTS:
     m_overlay->show();
   }
 
+  // Draw `patch` over the current image at `pos`, for progressive updates.
+  // Ignored if it doesn't fit in the current image.
+  void imshowRegion(const QPixmap &patch, QPoint pos) {
+    if (m_PixmapItem == nullptr ||
+        !m_Pixmap.rect().contains(QRect(pos, patch.size()))) {
+      return;
+    }
+
+    // Release the item's reference first, so painting doesn't detach (copy)
+    // the whole pixmap.
+    m_PixmapItem->setPixmap({});
+    {
+      QPainter painter(&m_Pixmap);
+      painter.drawPixmap(pos, patch);
+    }
+    m_PixmapItem->setPixmap(m_Pixmap);
+  }
+
   void resetZoomOnNext() { m_resetZoomOnNext = true; }
   [[nodiscard]] QAction *actResetZoom() { return m_actResetZoom; }
 
@@ -157,7 +176,7 @@ protected:
 private:
   QGraphicsScene *m_Scene;
   QPixmap m_Pixmap;
-  QGraphicsItem *m_PixmapItem{};
+  QGraphicsPixmapItem *m_PixmapItem{};
   ImageOverlay *m_overlay;
 
   double m_scaleFactor{1.0};
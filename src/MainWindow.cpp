@@ -1,5 +1,6 @@
 #include "MainWindow.hpp"
 #include "AcquisitionController.hpp"
+#include "CatalogBrowser.hpp"
 #include "DAQ.hpp"
 #include "ExportSettings.hpp"
 #include "FileIO.hpp"
@@ -8,7 +9,9 @@
 #include "MotorDriver.hpp"
 #include "OCTRecon.hpp"
 #include "OCTReconParamsController.hpp"
+#include "Pipeline.hpp"
 #include "ReconWorker.hpp"
+#include "SweepWorker.hpp"
 #include "datetime.hpp"
 #include "strOps.hpp"
 #include "timeit.hpp"
@@ -38,7 +41,7 @@ MainWindow::MainWindow()
       m_menuView(menuBar()->addMenu("&View")), m_imageDisplay(new ImageDisplay),
       m_frameController(new FrameController),
       m_reconParamsController(new OCTReconParamsController),
-      m_motorDriver(new MotorDriver),
+      m_motorDriver(new MotorDriver), m_catalogBrowser(new CatalogBrowser),
       m_ringBuffer(std::make_shared<RingBuffer<OCTData<Float>>>()),
       m_worker(new ReconWorker(m_ringBuffer, DatFileReader::ALineSize,
                                m_imageDisplay)),
@@ -103,6 +106,26 @@ MainWindow::MainWindow()
     menuBar()->addMenu(m_exportSettingsWidget->menu());
   }
 
+  // Catalog browser
+  {
+    auto *dock = new QDockWidget("Catalog");
+    this->addDockWidget(Qt::BottomDockWidgetArea, dock);
+    m_menuView->addAction(dock->toggleViewAction());
+    dock->toggleViewAction()->setShortcut({Qt::CTRL | Qt::SHIFT | Qt::Key_C});
+
+    dock->setWidget(m_catalogBrowser);
+    dock->hide();
+
+    connect(m_catalogBrowser, &CatalogBrowser::openRequested, this,
+            [this](const QString &qpath, bool isDatDirectory) {
+              if (isDatDirectory) {
+                tryLoadDatDirectory(qpath);
+              } else {
+                tryLoadBinfile(qpath);
+              }
+            });
+  }
+
   // Motor Driver
   auto *motorDock = new QDockWidget("Motor control");
   addDockWidget(Qt::TopDockWidgetArea, motorDock);
@@ -126,6 +149,7 @@ MainWindow::MainWindow()
             &AcquisitionControllerObj::sigAcquisitionStarted, this, [this]() {
               // Set reconWorker to live (no block) mode
               m_worker->setNoBlockMode(true);
+              m_sweepWorker->setParams(m_reconParamsController->params());
 
               // Clear overlay progress
               m_imageDisplay->overlay()->setProgress(0, 0);
@@ -139,6 +163,36 @@ MainWindow::MainWindow()
               tryLoadBinfile(qpath);
             });
 
+    // Sweep display. Chunks are reconstructed in their own thread so the
+    // ReconWorker keeps processing full frames.
+    m_chunkBuffer = std::make_shared<RingBuffer<OCTChunk<Float>>>();
+    m_sweepWorker = new SweepWorker(m_chunkBuffer, DatFileReader::ALineSize,
+                                    m_imageDisplay);
+    m_acqController->setChunkBuffer(m_chunkBuffer);
+
+    m_worker->setLiveFrameCallback(
+        [sweepWorker = m_sweepWorker](const OCTData<Float> &dat,
+                                      std::optional<float> latencyMs) {
+          if (!sweepWorker->isEnabled()) {
+            return false;
+          }
+          if (latencyMs) {
+            sweepWorker->setBaseImage(dat.imgRect, dat.i, *latencyMs);
+          }
+          return true;
+        });
+
+    connect(m_acqController, &AcquisitionController::sigSweepDisplayToggled,
+            this, [this](bool enabled) { m_sweepWorker->setEnabled(enabled); });
+
+    m_sweepWorker->moveToThread(&m_sweepThread);
+    connect(&m_sweepThread, &QThread::finished, m_sweepWorker,
+            &SweepWorker::deleteLater);
+    connect(m_sweepWorker, &SweepWorker::statusMessage, this,
+            &MainWindow::statusBarMessage);
+    m_sweepThread.start();
+    QMetaObject::invokeMethod(m_sweepWorker, &SweepWorker::start);
+
     // Updated background
     connect(m_acqController, &AcquisitionController::sigUpdatedBackground, this,
             [this]() {
@@ -208,6 +262,18 @@ MainWindow::MainWindow()
     });
   }
 
+  {
+    auto *act = new QAction("Load pipeline config");
+    m_menuFile->addAction(act);
+
+    connect(act, &QAction::triggered, this, [this]() {
+      const QString filename = QFileDialog::getOpenFileName(
+          this, "Select a pipeline config", defaultDataDir,
+          "Pipeline config (*.txt)");
+      this->tryLoadPipelineConfig(filename);
+    });
+  }
+
   // Recon worker thread
   {
     m_worker->moveToThread(&m_workerThread);
@@ -233,6 +299,17 @@ MainWindow::MainWindow()
 
   // Auto load calibration data if exists at C:/Data/OCTcalib
   tryLoadCalibDirectory(defaultCalibDir);
+
+  // Catalog the default data directory
+  if (fs::is_directory(toPath(defaultDataDir))) {
+    m_catalogBrowser->setRoot(defaultDataDir);
+  }
+
+  // Auto load pipeline config if exists at C:/Data/OCTPipeline.txt
+  if (const auto pipelineConfig = toPath(defaultDataDir) / "OCTPipeline.txt";
+      fs::exists(pipelineConfig)) {
+    tryLoadPipelineConfig(toQString(pipelineConfig));
+  }
 }
 
 void MainWindow::dragEnterEvent(QDragEnterEvent *event) {
@@ -283,9 +360,11 @@ void MainWindow::tryLoadCalibDirectory(const QString &calibDir) {
     statusBar()->showMessage(msg, statusTimeoutMs);
 
     m_worker->setCalibration(m_calib);
+    m_catalogBrowser->setCalibration(m_calib);
 
 #ifdef OCTGUI_HAS_ALAZAR
     m_acqController->setCalibration(m_calib);
+    m_sweepWorker->setCalibration(m_calib);
 #endif
 
     if (m_datReader.ok()) {
@@ -342,6 +421,27 @@ void MainWindow::tryLoadBinfile(const QString &qpath) {
   }
 };
 
+void MainWindow::tryLoadPipelineConfig(const QString &qpath) {
+  auto pipeline = std::make_shared<Pipeline<Float>>();
+
+  constexpr int statusTimeoutMs = 10000;
+  if (const auto err = pipeline->loadConfig(toPath(qpath)); err) {
+    const auto msg = fmt::format("Failed to load pipeline config {}: {}",
+                                 toPath(qpath), *err);
+    statusBar()->showMessage(QString::fromStdString(msg), statusTimeoutMs);
+    return;
+  }
+
+  const auto msg = fmt::format("Loaded pipeline config {}: {}", toPath(qpath),
+                               pipeline->describe());
+  statusBar()->showMessage(QString::fromStdString(msg), statusTimeoutMs);
+  m_worker->setPipeline(std::move(pipeline));
+
+  if (m_calib != nullptr && m_datReader.ok()) {
+    loadFrame(m_frameController->pos());
+  }
+}
+
 void MainWindow::loadFrame(size_t i) {
   if (m_calib != nullptr && m_datReader.ok()) {
     TimeIt timeit;
@@ -352,6 +452,9 @@ void MainWindow::loadFrame(size_t i) {
       m_reconParamsController->clearOffset();
     }
     m_worker->setParams(params);
+#ifdef OCTGUI_HAS_ALAZAR
+    m_sweepWorker->setParams(params);
+#endif
 
     if (m_exportSettingsWidget->dirty()) {
       m_worker->setExportSettings(m_exportSettingsWidget->settings());
@@ -362,6 +465,7 @@ void MainWindow::loadFrame(size_t i) {
 
     m_ringBuffer->produce([&, this](std::shared_ptr<OCTData<Float>> &dat) {
       dat->i = i;
+      dat->acquiredAt = {};
       if (auto err = m_datReader.read(i, 1, dat->fringe); err) {
         const auto msg = fmt::format("While loading {}/{}, got {}", i,
                                      m_datReader.size(), *err);
@@ -408,6 +512,14 @@ void MainWindow::closeEvent(QCloseEvent *event) {
   m_worker->setShouldStop(true);
   m_workerThread.quit();
   m_workerThread.wait();
+
+#ifdef OCTGUI_HAS_ALAZAR
+  // Set stop first, so the worker exits after `quit` wakes it
+  m_sweepWorker->setShouldStop(true);
+  m_chunkBuffer->quit();
+  m_sweepThread.quit();
+  m_sweepThread.wait();
+#endif
   QMainWindow::closeEvent(event);
 }
 
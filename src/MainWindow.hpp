@@ -1,5 +1,6 @@
 #pragma once
 
+#include "CatalogBrowser.hpp"
 #include "Common.hpp"
 #include "ExportSettings.hpp"
 #include "FileIO.hpp"
@@ -21,6 +22,7 @@
 
 #ifdef OCTGUI_HAS_ALAZAR
 #include "AcquisitionController.hpp"
+#include "SweepWorker.hpp"
 #endif
 
 namespace OCT {
@@ -38,6 +40,7 @@ public Q_SLOTS:
   void tryLoadCalibDirectory(const QString &calibDir);
   void tryLoadDatDirectory(const QString &qdir);
   void tryLoadBinfile(const QString &qpath);
+  void tryLoadPipelineConfig(const QString &qpath);
 
   void loadFrame(size_t i);
 
@@ -55,6 +58,7 @@ private:
   FrameController *m_frameController;
   OCTReconParamsController *m_reconParamsController;
   MotorDriver *m_motorDriver;
+  CatalogBrowser *m_catalogBrowser;
 
 #ifdef WIN32
   QString defaultDataDir{"C:/Data/"};
@@ -76,6 +80,11 @@ private:
 #ifdef OCTGUI_HAS_ALAZAR
   // Acquisition
   AcquisitionController *m_acqController;
+
+  // Progressive display of sub-frame chunks during acquisition
+  std::shared_ptr<RingBuffer<OCTChunk<Float>>> m_chunkBuffer;
+  SweepWorker *m_sweepWorker;
+  QThread m_sweepThread;
 #endif
 
   // Called after a new DatReader is ready.
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Common.hpp"
+#include "timeit.hpp"
 #include <fftconv/aligned_vector.hpp>
 #include <opencv2/opencv.hpp>
 
@@ -10,9 +11,25 @@ template <Floating T> struct OCTData {
   fftconv::AlignedVector<uint16_t> fringe;
   size_t i{};
 
+  // During live acquisition, the mean time the A-lines of this frame arrived
+  // from the DAQ. Default (epoch) when loaded from file.
+  TimeIt::clock::time_point acquiredAt{};
+
   cv::Mat_<uint8_t> imgRect;
   cv::Mat_<uint8_t> imgRadial;
   cv::Mat_<uint8_t> imgCombined;
 };
 
-} // namespace OCT
\ No newline at end of file
+// A sub-frame chunk of consecutive A-lines, produced by the DAQ as soon as
+// the chunk's DMA buffer completes.
+template <Floating T> struct OCTChunk {
+  fftconv::AlignedVector<uint16_t> fringe;
+  size_t frameIdx{};
+  size_t chunkIdx{};
+  size_t chunksPerFrame{};
+  size_t linesPerFrame{};
+
+  TimeIt::clock::time_point acquiredAt{};
+};
+
+} // namespace OCT
@@ -2,9 +2,12 @@
 
 #include "Calibration.hpp"
 #include "Common.hpp"
+#include "fftwBatched.hpp"
 #include "phasecorr.hpp"
 #include "timeit.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <fftconv/aligned_vector.hpp>
 #include <fftconv/fftw.hpp>
 #include <fftw3.h>
@@ -139,6 +142,61 @@ template <Floating T> auto getHamming(int n) {
   return win;
 }
 
+// Number of A-lines processed in lockstep by `preprocessLockstep`.
+// 8 floats fill one AVX2 register.
+constexpr size_t LockstepLanes = 8;
+
+/**
+Background subtraction and k-linearization of `Lanes` A-lines in lockstep.
+
+The phase calibration indices and coefficients are the same for every A-line
+in a frame, so the fringe of `Lanes` consecutive A-lines is transposed (in
+blocks) into `interleaved`, where sample `i` of lane `j` is at
+`interleaved[i * Lanes + j]`. The indexed gathers of the k-linearization then
+become contiguous loads of `Lanes` values with broadcast coefficients.
+
+`linearKFringe` is written in the same interleaved layout, which is the input
+layout of `EngineR2CBatched`.
+ */
+template <size_t Lanes, Floating T>
+void preprocessLockstep(const Calibration<T> &calib,
+                        const std::span<const uint16_t> fringe,
+                        const size_t ALineSize, const std::span<T> interleaved,
+                        const std::span<T> linearKFringe) {
+  assert(fringe.size() == Lanes * ALineSize);
+  assert(interleaved.size() >= Lanes * ALineSize);
+  assert(linearKFringe.size() >= Lanes * ALineSize);
+
+  // 1. Blocked transpose and subtract background
+  constexpr size_t blockSize = 64;
+  for (size_t i0 = 0; i0 < ALineSize; i0 += blockSize) {
+    const size_t i1 = std::min(i0 + blockSize, ALineSize);
+    for (size_t lane = 0; lane < Lanes; ++lane) {
+      const uint16_t *src = fringe.data() + lane * ALineSize;
+      for (size_t i = i0; i < i1; ++i) {
+        interleaved[i * Lanes + lane] =
+            static_cast<T>(src[i]) - calib.background[i];
+      }
+    }
+  }
+
+  // 2. Interpolate phase calibration data
+  for (size_t i = 0; i < ALineSize - 1; ++i) {
+    const auto idx = calib.phaseCalib[i].idx;
+    const auto unit = calib.phaseCalib[idx];
+    const T l_coeff = unit.l_coeff;
+    const T r_coeff = unit.r_coeff;
+
+    const T *left = interleaved.data() + idx * Lanes;
+    const T *right = left + Lanes;
+    T *dst = linearKFringe.data() + i * Lanes;
+    for (size_t lane = 0; lane < Lanes; ++lane) {
+      dst[lane] = left[lane] * l_coeff + right[lane] * r_coeff;
+    }
+  }
+  std::fill_n(linearKFringe.data() + (ALineSize - 1) * Lanes, Lanes, T{});
+}
+
 /**
 Original impl. without split spectrum
  */
@@ -240,35 +298,70 @@ reconBscan(const Calibration<T> &calib, const std::span<const uint16_t> fringe,
 }
 
 /**
-Split the `n` point sampled spectral fringe to `n_splits`, using size `n /
-n_splits` FFTs instead of size `n` FFTs, and average the result
- */
-template <Floating T>
-[[nodiscard]] cv::Mat_<uint8_t> reconBscan_splitSpectrum(
-    const Calibration<T> &calib, const std::span<const uint16_t> fringe,
-    const size_t ALineSize, const OCTReconParams<T> &params = {}) {
+Run the split spectrum FFT over every A-line of `fringe`.
 
+The `n` point sampled spectral fringe of each A-line is background subtracted,
+k-linearized, then split into `n_splits` windowed FFTs of size `n / n_splits`.
+`func(line, i_split, spectrum)` is called with the spectrum of split `i_split`
+of A-line `line` (`spectrum.size() == n / n_splits`). It is called
+concurrently for different A-lines.
+ */
+template <Floating T, typename Func>
+void forEachSplitSpectrum(const Calibration<T> &calib,
+                          const std::span<const uint16_t> fringe,
+                          const size_t ALineSize, const size_t n_splits,
+                          const Func &func) {
   assert((fringe.size() % ALineSize) == 0);
   const auto nLines = fringe.size() / ALineSize;
-
-  const size_t n_splits = params.n_splits;
   const size_t splitSize = ALineSize / n_splits;
-
   const auto win = getHamming<T>(splitSize);
-  const auto contrast = params.contrast;
-  const auto brightness = params.brightness;
-  const size_t imageDepth = params.imageDepth;
 
-  // cv::Mat constructor takes (height, width)
-  // std::vector<cv::Mat_<T>> mats(n_splits);
-  // for (int i_split = 0; i_split < n_splits; ++i_split) {
-  //   mats[i_split] = cv::Mat_<T>(nLines, imageDepth);
-  // }
-  cv::Mat_<T> mat = cv::Mat_<T>::zeros(nLines, imageDepth);
+  // Full blocks of `Lanes` A-lines go through the lockstep kernel and a
+  // batched FFT.
+  constexpr size_t Lanes = LockstepLanes;
+  const size_t nBlocks = nLines / Lanes;
+  const auto &fftBatched = EngineR2CBatched<T>::get(splitSize, Lanes);
+
+  tbb::blocked_range<size_t> blocks(0, nBlocks);
+  tbb::parallel_for(blocks, [&](const tbb::blocked_range<size_t> &blocks) {
+    R2CBatchedBuffer<T> fftBuf(splitSize, Lanes);
+    std::vector<T, tbb::scalable_allocator<T>> interleaved(ALineSize * Lanes);
+    std::vector<T, tbb::scalable_allocator<T>> linearKFringe(ALineSize *
+                                                             Lanes);
+
+    for (size_t b = blocks.begin(); b < blocks.end(); ++b) {
+      const size_t line0 = b * Lanes;
+
+      // 1-2. Subtract background and interpolate phase calibration data
+      preprocessLockstep<Lanes, T>(
+          calib, fringe.subspan(line0 * ALineSize, Lanes * ALineSize),
+          ALineSize, interleaved, linearKFringe);
+
+      for (int i_split = 0; i_split < n_splits; ++i_split) {
+        // 3. Windowed FFT over splits
+        const T *src = linearKFringe.data() + i_split * splitSize * Lanes;
+        for (size_t i = 0; i < splitSize; ++i) {
+          const T w = win[i];
+          for (size_t lane = 0; lane < Lanes; ++lane) {
+            fftBuf.in[i * Lanes + lane] = w * src[i * Lanes + lane];
+          }
+        }
+        fftBatched.forward(fftBuf.in, fftBuf.out);
+
+        // 4. Hand over the result
+        for (size_t lane = 0; lane < Lanes; ++lane) {
+          func(line0 + lane, i_split,
+               std::span<const fftw::Complex<T>>{
+                   fftBuf.out + lane * splitSize, splitSize});
+        }
+      }
+    }
+  });
 
+  // Remaining A-lines are processed one at a time.
   const auto &fft = fftw::EngineR2C1D<T>::get(splitSize);
 
-  tbb::blocked_range<size_t> range(0, nLines);
+  tbb::blocked_range<size_t> range(nBlocks * Lanes, nLines);
   tbb::parallel_for(range, [&](const tbb::blocked_range<size_t> &range) {
     fftw::R2CBuffer<T> fftBuf(ALineSize);
     std::vector<T, tbb::scalable_allocator<T>> alineBuf(ALineSize);
@@ -300,53 +393,160 @@ template <Floating T>
         }
         fft.forward(fftBuf.in, fftBuf.out);
 
-        // 4. Copy result into image
-        T *outptr = reinterpret_cast<T *>(mat.ptr(j));
-        logCompress_add<T>({outptr, imageDepth}, {fftBuf.out, splitSize},
-                           contrast, brightness, params.clearTop);
+        // 4. Hand over the result
+        func(j, i_split,
+             std::span<const fftw::Complex<T>>{fftBuf.out, splitSize});
       }
     }
   });
+}
 
-  mat = mat.t();
+/**
+Split spectrum recon of the log compressed magnitude.
+`mat` is (re)allocated to (nLines, imageDepth), one A-line per row, and the
+log compressed magnitudes of all splits are summed.
+ */
+template <Floating T>
+void reconLogMagnitude(const Calibration<T> &calib,
+                       const std::span<const uint16_t> fringe,
+                       const size_t ALineSize, const OCTReconParams<T> &params,
+                       cv::Mat_<T> &mat) {
+  const auto nLines = fringe.size() / ALineSize;
+  const auto contrast = params.contrast;
+  const auto brightness = params.brightness;
+  const size_t imageDepth = params.imageDepth;
 
-  // Distortion correction and resize to theoretical aline number
-  {
-    TimeIt timeit;
+  // cv::Mat constructor takes (height, width)
+  mat.create(static_cast<int>(nLines), static_cast<int>(imageDepth));
+  mat.setTo(0);
+
+  forEachSplitSpectrum<T>(
+      calib, fringe, ALineSize, params.n_splits,
+      [&](size_t line, int /*i_split*/,
+          std::span<const fftw::Complex<T>> spectrum) {
+        T *outptr = reinterpret_cast<T *>(mat.ptr(line));
+        logCompress_add<T>({outptr, imageDepth}, spectrum, contrast,
+                           brightness, params.clearTop);
+      });
+}
 
-    size_t theoreticalALines = nLines;
-    if (nLines == 2500) {
-      // theoreticalALines = 2234;
-      // Don't need distortion correction for the ex vivo probe.
-    } else if (nLines == 2200) {
-      theoreticalALines = 2000;
+/**
+Split spectrum recon keeping the complex data.
+`cx` is (re)allocated to (nLines, n_splits * imageDepth). Row `j` holds the
+first `imageDepth` bins of each split of A-line `j`, split after split.
+ */
+template <Floating T>
+void reconComplex(const Calibration<T> &calib,
+                  const std::span<const uint16_t> fringe,
+                  const size_t ALineSize, const OCTReconParams<T> &params,
+                  cv::Mat_<cv::Vec<T, 2>> &cx) {
+  const auto nLines = fringe.size() / ALineSize;
+  const size_t imageDepth = params.imageDepth;
+  cx.create(static_cast<int>(nLines),
+            static_cast<int>(params.n_splits * imageDepth));
+
+  forEachSplitSpectrum<T>(
+      calib, fringe, ALineSize, params.n_splits,
+      [&](size_t line, int i_split,
+          std::span<const fftw::Complex<T>> spectrum) {
+        auto *outptr = reinterpret_cast<fftw::Complex<T> *>(
+            cx[static_cast<int>(line)] + i_split * imageDepth);
+        // fftw::Complex<T> is an array type, so copy the raw bytes
+        std::memcpy(outptr, spectrum.data(),
+                    imageDepth * sizeof(fftw::Complex<T>));
+      });
+}
 
-      const cv::Size targetSize(theoreticalALines, mat.rows);
-      const int distOffset =
-          getDistortionOffset(mat, theoreticalALines, nLines);
-      cv::resize(mat(cv::Rect(0, 0, theoreticalALines + distOffset, mat.rows)),
-                 mat, targetSize);
+/**
+Log compress the output of `reconComplex` and sum over splits. `mat` is
+(re)allocated to (nLines, imageDepth).
+ */
+template <Floating T>
+void logCompressSplits(const cv::Mat_<cv::Vec<T, 2>> &cx,
+                       const size_t ALineSize, const OCTReconParams<T> &params,
+                       cv::Mat_<T> &mat) {
+  const size_t n_splits = params.n_splits;
+  const size_t imageDepth = params.imageDepth;
+  const size_t splitSize = ALineSize / n_splits;
+  assert(static_cast<size_t>(cx.cols) == n_splits * imageDepth);
+
+  const T contrast = params.contrast;
+  const T brightness = params.brightness;
+  const T fct = 1.0 / splitSize;
+  const T fct2 = 20 * log10(fct); // 20 because fct is not squared
+
+  mat.create(cx.rows, static_cast<int>(imageDepth));
+  mat.setTo(0);
+
+  tbb::blocked_range<int> range(0, cx.rows);
+  tbb::parallel_for(range, [&](const tbb::blocked_range<int> &range) {
+    for (int j = range.begin(); j < range.end(); ++j) {
+      const cv::Vec<T, 2> *in = cx[j];
+      T *out = mat[j];
+      for (size_t i_split = 0; i_split < n_splits; ++i_split) {
+        const auto *inSplit = in + i_split * imageDepth;
+        for (size_t i = params.clearTop; i < imageDepth; ++i) {
+          const T ro = inSplit[i][0];
+          const T io = inSplit[i][1];
+          T val = ro * ro + io * io;
+          // Note the 10 * log10 is because val is squared
+          val = contrast * (10 * log10(val) + brightness + fct2);
+          out[i] += std::clamp<T>(val, 0, 255);
+        }
+      }
     }
+  });
+}
 
-    // fmt::println("Distortion correction elapsed: {} ms", timeit.get_ms());
+/**
+Number of A-lines in one rotation of the probe, given the number of A-lines
+acquired per frame.
+ */
+inline size_t getTheoreticalALines(size_t nLines) {
+  if (nLines == 2500) {
+    // return 2234;
+    // Don't need distortion correction for the ex vivo probe.
+    return nLines;
+  }
+  if (nLines == 2200) {
+    return 2000;
   }
+  return nLines;
+}
 
-  // Align Bscans
-  {
-    TimeIt timeit;
-    static cv::Mat_<T> prevMat;
-    if (prevMat.cols == mat.cols && prevMat.rows == mat.rows) {
-      int alignOffset = std::round(cvMod::phaseCorrelate(prevMat, mat).x);
-      circshift(mat, alignOffset + params.additionalOffset);
-    }
-    mat.copyTo(prevMat);
+/**
+Distortion correction and resize to theoretical aline number.
+`mat` is the transposed B-scan (one A-line per column).
+ */
+template <Floating T> void correctDistortion(cv::Mat_<T> &mat) {
+  TimeIt timeit;
+
+  const size_t nLines = mat.cols;
+  const size_t theoreticalALines = getTheoreticalALines(nLines);
+  if (theoreticalALines != nLines) {
+    const cv::Size targetSize(theoreticalALines, mat.rows);
+    const int distOffset = getDistortionOffset(mat, theoreticalALines, nLines);
+    cv::resize(mat(cv::Rect(0, 0, theoreticalALines + distOffset, mat.rows)),
+               mat, targetSize);
+  }
 
-    // fmt::println("Align correction elapsed: {} ms", timeit.get_ms());
+  // fmt::println("Distortion correction elapsed: {} ms", timeit.get_ms());
+}
+
+/**
+Align B-scan `mat` to the previous B-scan `prevMat` by phase correlation, then
+store `mat` in `prevMat` for the next call.
+ */
+template <Floating T>
+void alignBscan(cv::Mat_<T> &mat, cv::Mat_<T> &prevMat, int additionalOffset) {
+  TimeIt timeit;
+  if (prevMat.cols == mat.cols && prevMat.rows == mat.rows) {
+    int alignOffset = std::round(cvMod::phaseCorrelate(prevMat, mat).x);
+    circshift(mat, alignOffset + additionalOffset);
   }
+  mat.copyTo(prevMat);
 
-  cv::Mat_<uint8_t> outmat;
-  mat.convertTo(outmat, CV_8U);
-  return mat;
+  // fmt::println("Align correction elapsed: {} ms", timeit.get_ms());
 }
 
 inline void makeRadialImage(const cv::Mat_<uint8_t> &in, cv::Mat_<uint8_t> &out,
@@ -377,6 +577,128 @@ inline void makeRadialImage(const cv::Mat_<uint8_t> &in, cv::Mat_<uint8_t> &out,
   cv::flip(out, out, 1);
 }
 
+/**
+Precomputed inverse polar map equivalent to `makeRadialImage`, split into
+angular sectors so that one wedge of the radial image can be redrawn from a
+few rows of the polar image.
+
+The polar image has one A-line per row (`nRows` rows for a full rotation) and
+`padTop + imageDepth` columns, i.e. the transpose of the padded rect image.
+The radial image is (2 * imageDepth, 2 * imageDepth).
+ */
+class SectorPolarMap {
+public:
+  SectorPolarMap() = default;
+  SectorPolarMap(int nRows, int imageDepth, int padTop, int nSectors)
+      : m_nRows(nRows), m_imageDepth(imageDepth), m_padTop(padTop) {
+    const int dim = imageDepth;
+    const int size = 2 * dim;
+    const int nCols = padTop + imageDepth;
+    const auto center = static_cast<float>(dim);
+    constexpr auto twoPi = 2 * std::numbers::pi_v<float>;
+
+    // Same mapping as cv::warpPolar(WARP_INVERSE_MAP) followed by a
+    // horizontal flip.
+    cv::Mat_<float> mapx(size, size, -1.0F);
+    cv::Mat_<float> mapy(size, size, -1.0F);
+    cv::Mat_<int> sectorOf(size, size, -1);
+    const float kAngle = static_cast<float>(nRows) / twoPi;
+    const float kMag = static_cast<float>(nCols) / static_cast<float>(dim);
+    // Keep the 2x2 interpolation neighbourhood inside the polar image.
+    const float maxRow = static_cast<float>(nRows) - 1.001F;
+    const float maxCol = static_cast<float>(nCols) - 1.001F;
+
+    for (int y = 0; y < size; ++y) {
+      for (int xFlipped = 0; xFlipped < size; ++xFlipped) {
+        const auto dx = static_cast<float>(size - 1 - xFlipped) - center;
+        const auto dy = static_cast<float>(y) - center;
+        const float rho = std::sqrt(dx * dx + dy * dy);
+        if (rho >= static_cast<float>(dim)) {
+          continue;
+        }
+        float angle = std::atan2(dy, dx);
+        if (angle < 0) {
+          angle += twoPi;
+        }
+
+        const float row = std::min(angle * kAngle, maxRow);
+        mapx(y, xFlipped) = std::min(rho * kMag, maxCol);
+        mapy(y, xFlipped) = row;
+        sectorOf(y, xFlipped) =
+            std::min(static_cast<int>(row) * nSectors / nRows, nSectors - 1);
+      }
+    }
+
+    // Crop the maps to each sector's bounding box. Pixels of other sectors
+    // map outside the polar image and are left untouched by
+    // cv::BORDER_TRANSPARENT.
+    m_sectors.resize(nSectors);
+    for (int s = 0; s < nSectors; ++s) {
+      cv::Mat_<uint8_t> mask = sectorOf == s;
+      auto &sector = m_sectors[s];
+      sector.roi = cv::boundingRect(mask);
+      if (sector.roi.empty()) {
+        continue;
+      }
+      mapx(sector.roi).copyTo(sector.mapx);
+      mapy(sector.roi).copyTo(sector.mapy);
+      sector.mapx.setTo(-1.0F, ~mask(sector.roi));
+      sector.mapy.setTo(-1.0F, ~mask(sector.roi));
+    }
+  }
+
+  [[nodiscard]] bool matches(int nRows, int imageDepth, int padTop) const {
+    return m_nRows == nRows && m_imageDepth == imageDepth &&
+           m_padTop == padTop;
+  }
+
+  [[nodiscard]] int rows() const { return m_nRows; }
+  [[nodiscard]] int cols() const { return m_padTop + m_imageDepth; }
+  [[nodiscard]] int padTop() const { return m_padTop; }
+  [[nodiscard]] cv::Size radialSize() const {
+    return {2 * m_imageDepth, 2 * m_imageDepth};
+  }
+
+  // Redraw the sectors of `radial` covering polar rows [row0, row1).
+  // Returns the bounding box of the redrawn pixels.
+  cv::Rect update(const cv::Mat_<uint8_t> &polar, cv::Mat_<uint8_t> &radial,
+                  int row0, int row1) const {
+    assert(polar.rows == m_nRows && polar.cols == cols());
+    assert(radial.size() == radialSize());
+    cv::Rect bbox;
+    if (row1 <= row0) {
+      return bbox;
+    }
+
+    const auto nSectors = static_cast<int>(m_sectors.size());
+    const int s0 = row0 * nSectors / m_nRows;
+    const int s1 = std::min((row1 - 1) * nSectors / m_nRows, nSectors - 1);
+    for (int s = s0; s <= s1; ++s) {
+      const auto &sector = m_sectors[s];
+      if (sector.roi.empty()) {
+        continue;
+      }
+      cv::Mat dst = radial(sector.roi);
+      cv::remap(polar, dst, sector.mapx, sector.mapy, cv::INTER_LINEAR,
+                cv::BORDER_TRANSPARENT);
+      bbox |= sector.roi;
+    }
+    return bbox;
+  }
+
+private:
+  struct Sector {
+    cv::Rect roi;
+    cv::Mat_<float> mapx;
+    cv::Mat_<float> mapy;
+  };
+
+  int m_nRows{};
+  int m_imageDepth{};
+  int m_padTop{};
+  std::vector<Sector> m_sectors;
+};
+
 } // namespace OCT
 
 // NOLINTEND(*-pointer-arithmetic, *-magic-numbers, *-reinterpret-cast)
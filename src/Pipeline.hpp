@@ -0,0 +1,675 @@
+/*
+Composable OCT processing pipeline.
+
+A pipeline is a list of stages. Each stage declares the ports it reads and
+writes. A port is a data kind and a buffer name, so several branches can
+carry the same kind of data side by side. The pipeline derives the dependency
+graph from the ports: a stage depends on every earlier stage that writes a
+port it reads or writes, or that reads a port it writes. Stages on the same
+level of the graph are independent and run in parallel.
+
+The active pipeline is read from a config file with one stage per line,
+in execution order. Blank lines and lines starting with '#' are ignored.
+Stage options are given as key=value pairs after the stage name:
+
+  # Default pipeline
+  recon
+  distortion
+  align
+  rect
+  # median ksize=3
+  radial
+
+Buffers are named with the `in` and `out` options. Without them a stage reads
+the "main" buffer, and writes a buffer with the same name as its input. The
+display shows the "main" rect and radial images. For example, a speckle
+reduced rect view next to an unfiltered radial view:
+
+  recon
+  distortion
+  align
+  rect out=raw
+  median in=raw out=main ksize=5
+  radial in=raw out=main
+
+Here `median` and `radial` both read the "raw" rect and run in parallel.
+
+`compound` takes a comma separated list of magnitude inputs and writes their
+mean. For example, overlaying the inter-frame difference (flow) on the
+structural image:
+
+  recon
+  distortion
+  align
+  angio out=flow
+  compound in=main,flow
+  rect
+  radial
+
+Stages not listed (or commented out) are not part of the graph and cost
+nothing.
+*/
+#pragma once
+
+#include "Calibration.hpp"
+#include "Common.hpp"
+#include "OCTRecon.hpp"
+#include "timeit.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <optional>
+#include <set>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tbb/parallel_for.h>
+#include <utility>
+#include <vector>
+
+namespace OCT {
+
+namespace fs = std::filesystem;
+
+// Data kinds passed between stages.
+enum class Port : std::uint8_t {
+  Fringe = 0, // Raw uint16 fringe of one frame (source)
+  Complex,    // Complex spectra, (nLines, n_splits * imageDepth)
+  Magnitude,  // Log compressed magnitude, (imageDepth, nLines)
+  Rect,       // uint8 rect image
+  Radial,     // uint8 radial image
+  Count
+};
+
+[[nodiscard]] inline const char *toString(Port port) {
+  // NOLINTNEXTLINE(*-default-case)
+  switch (port) {
+  case Port::Fringe:
+    return "fringe";
+  case Port::Complex:
+    return "complex";
+  case Port::Magnitude:
+    return "magnitude";
+  case Port::Rect:
+    return "rect";
+  case Port::Radial:
+    return "radial";
+  case Port::Count:
+    break;
+  }
+  return "?";
+}
+
+// Name of the default buffer of every data kind.
+inline constexpr const char *MainBuffer = "main";
+
+// A named buffer of one data kind.
+struct PortRef {
+  Port kind;
+  std::string name;
+
+  bool operator==(const PortRef &) const = default;
+  auto operator<=>(const PortRef &) const = default;
+};
+
+[[nodiscard]] inline std::string toString(const PortRef &port) {
+  return fmt::format("{} '{}'", toString(port.kind), port.name);
+}
+
+/**
+Buffers for every port, by name. Owned by the pipeline and reused across
+frames, so a stage writing a buffer of the same size as the last frame doesn't
+allocate. Stages that transform a port in place share its buffer.
+
+Every buffer written by a stage is created when the pipeline is built, so the
+maps aren't modified while stages run in parallel.
+ */
+template <Floating T> struct PipelineBuffers {
+  std::span<const uint16_t> fringe;
+  std::map<std::string, cv::Mat_<cv::Vec<T, 2>>> complex;
+  std::map<std::string, cv::Mat_<T>> magnitude;
+  std::map<std::string, cv::Mat_<uint8_t>> rect;
+  std::map<std::string, cv::Mat_<uint8_t>> radial;
+
+  void create(const PortRef &port) {
+    // NOLINTNEXTLINE(*-default-case)
+    switch (port.kind) {
+    case Port::Complex:
+      complex[port.name];
+      break;
+    case Port::Magnitude:
+      magnitude[port.name];
+      break;
+    case Port::Rect:
+      rect[port.name];
+      break;
+    case Port::Radial:
+      radial[port.name];
+      break;
+    case Port::Fringe:
+    case Port::Count:
+      break;
+    }
+  }
+};
+
+// Read-only inputs shared by all stages for one frame.
+template <Floating T> struct StageContext {
+  const Calibration<T> &calib;
+  size_t ALineSize;
+  const OCTReconParams<T> &params;
+};
+
+using StageOptions = std::map<std::string, std::string>;
+
+template <Floating T> class Stage {
+public:
+  Stage() = default;
+  Stage(const Stage &) = delete;
+  Stage(Stage &&) = delete;
+  Stage &operator=(const Stage &) = delete;
+  Stage &operator=(Stage &&) = delete;
+  virtual ~Stage() = default;
+
+  [[nodiscard]] virtual std::vector<PortRef> inputs() const = 0;
+  [[nodiscard]] virtual std::vector<PortRef> outputs() const = 0;
+  virtual void run(const StageContext<T> &ctx, PipelineBuffers<T> &buf) = 0;
+};
+
+/**
+Stage with one input and one output port. The buffer names are read from the
+`in` and `out` options. `in` defaults to the main buffer, `out` to the name of
+the input. The fringe has a single (main) buffer.
+ */
+template <Floating T> class UnaryStage : public Stage<T> {
+public:
+  UnaryStage(Port inKind, Port outKind, const StageOptions &opts)
+      : m_in{inKind, option(opts, "in", MainBuffer)},
+        m_out{outKind, option(opts, "out", m_in.name)} {
+    if (inKind == Port::Fringe && m_in.name != MainBuffer) {
+      throw std::invalid_argument("the fringe has no named buffers");
+    }
+  }
+
+  std::vector<PortRef> inputs() const override { return {m_in}; }
+  std::vector<PortRef> outputs() const override { return {m_out}; }
+
+protected:
+  PortRef m_in;
+  PortRef m_out;
+
+  static std::string option(const StageOptions &opts, const std::string &key,
+                            const std::string &defaultValue) {
+    const auto it = opts.find(key);
+    return it == opts.end() ? defaultValue : it->second;
+  }
+};
+
+namespace stages {
+
+// Fused FFT and log compression: fringe -> magnitude
+template <Floating T> class Recon : public UnaryStage<T> {
+public:
+  explicit Recon(const StageOptions &opts)
+      : UnaryStage<T>(Port::Fringe, Port::Magnitude, opts) {}
+  void run(const StageContext<T> &ctx, PipelineBuffers<T> &buf) override {
+    reconLogMagnitude<T>(ctx.calib, buf.fringe, ctx.ALineSize, ctx.params,
+                         m_mat);
+    cv::transpose(m_mat, buf.magnitude.at(this->m_out.name));
+  }
+
+private:
+  cv::Mat_<T> m_mat;
+};
+
+// FFT keeping the complex data: fringe -> complex
+template <Floating T> class FFT : public UnaryStage<T> {
+public:
+  explicit FFT(const StageOptions &opts)
+      : UnaryStage<T>(Port::Fringe, Port::Complex, opts) {}
+  void run(const StageContext<T> &ctx, PipelineBuffers<T> &buf) override {
+    reconComplex<T>(ctx.calib, buf.fringe, ctx.ALineSize, ctx.params,
+                    buf.complex.at(this->m_out.name));
+  }
+};
+
+// complex -> magnitude
+template <Floating T> class LogCompress : public UnaryStage<T> {
+public:
+  explicit LogCompress(const StageOptions &opts)
+      : UnaryStage<T>(Port::Complex, Port::Magnitude, opts) {}
+  void run(const StageContext<T> &ctx, PipelineBuffers<T> &buf) override {
+    logCompressSplits<T>(buf.complex.at(this->m_in.name), ctx.ALineSize,
+                         ctx.params, m_mat);
+    cv::transpose(m_mat, buf.magnitude.at(this->m_out.name));
+  }
+
+private:
+  cv::Mat_<T> m_mat;
+};
+
+// magnitude -> magnitude
+template <Floating T> class Distortion : public UnaryStage<T> {
+public:
+  explicit Distortion(const StageOptions &opts)
+      : UnaryStage<T>(Port::Magnitude, Port::Magnitude, opts) {}
+  void run(const StageContext<T> & /*ctx*/,
+           PipelineBuffers<T> &buf) override {
+    auto &out = buf.magnitude.at(this->m_out.name);
+    if (this->m_in != this->m_out) {
+      buf.magnitude.at(this->m_in.name).copyTo(out);
+    }
+    correctDistortion<T>(out);
+  }
+};
+
+// magnitude -> magnitude
+template <Floating T> class Align : public UnaryStage<T> {
+public:
+  explicit Align(const StageOptions &opts)
+      : UnaryStage<T>(Port::Magnitude, Port::Magnitude, opts) {}
+  void run(const StageContext<T> &ctx, PipelineBuffers<T> &buf) override {
+    auto &out = buf.magnitude.at(this->m_out.name);
+    if (this->m_in != this->m_out) {
+      buf.magnitude.at(this->m_in.name).copyTo(out);
+    }
+    alignBscan<T>(out, m_prevMat, ctx.params.additionalOffset);
+  }
+
+private:
+  cv::Mat_<T> m_prevMat;
+};
+
+// magnitude -> rect
+template <Floating T> class Rect : public UnaryStage<T> {
+public:
+  explicit Rect(const StageOptions &opts)
+      : UnaryStage<T>(Port::Magnitude, Port::Rect, opts) {}
+  void run(const StageContext<T> & /*ctx*/,
+           PipelineBuffers<T> &buf) override {
+    buf.magnitude.at(this->m_in.name)
+        .convertTo(buf.rect.at(this->m_out.name), CV_8U);
+  }
+};
+
+// Median filter for speckle reduction: rect -> rect
+template <Floating T> class Median : public UnaryStage<T> {
+public:
+  Median(const StageOptions &opts, int ksize)
+      : UnaryStage<T>(Port::Rect, Port::Rect, opts), m_ksize(ksize) {}
+  void run(const StageContext<T> & /*ctx*/,
+           PipelineBuffers<T> &buf) override {
+    cv::medianBlur(buf.rect.at(this->m_in.name), m_tmp, m_ksize);
+    std::swap(buf.rect.at(this->m_out.name), m_tmp);
+  }
+
+private:
+  int m_ksize;
+  cv::Mat_<uint8_t> m_tmp;
+};
+
+// rect -> radial
+template <Floating T> class Radial : public UnaryStage<T> {
+public:
+  explicit Radial(const StageOptions &opts)
+      : UnaryStage<T>(Port::Rect, Port::Radial, opts) {}
+  void run(const StageContext<T> &ctx, PipelineBuffers<T> &buf) override {
+    makeRadialImage(buf.rect.at(this->m_in.name),
+                    buf.radial.at(this->m_out.name), ctx.params.padTop);
+  }
+};
+
+// Mean of several magnitude buffers of the same size (e.g. compounding of
+// differently processed branches): magnitude... -> magnitude
+template <Floating T> class Compound : public Stage<T> {
+public:
+  explicit Compound(const StageOptions &opts) {
+    const auto it = opts.find("in");
+    if (it == opts.end()) {
+      throw std::invalid_argument("in=<buffer>,<buffer>,... is required");
+    }
+    std::istringstream iss(it->second);
+    std::string name;
+    while (std::getline(iss, name, ',')) {
+      m_in.push_back({Port::Magnitude, name});
+    }
+    if (m_in.size() < 2) {
+      throw std::invalid_argument("needs at least 2 inputs");
+    }
+    const auto out = opts.find("out");
+    m_out = {Port::Magnitude, out == opts.end() ? MainBuffer : out->second};
+  }
+
+  std::vector<PortRef> inputs() const override { return m_in; }
+  std::vector<PortRef> outputs() const override { return {m_out}; }
+  void run(const StageContext<T> & /*ctx*/,
+           PipelineBuffers<T> &buf) override {
+    buf.magnitude.at(m_in.front().name).copyTo(m_sum);
+    for (size_t i = 1; i < m_in.size(); ++i) {
+      m_sum += buf.magnitude.at(m_in[i].name);
+    }
+    m_sum.convertTo(buf.magnitude.at(m_out.name), -1,
+                    1.0 / static_cast<double>(m_in.size()));
+  }
+
+private:
+  std::vector<PortRef> m_in;
+  PortRef m_out;
+  cv::Mat_<T> m_sum;
+};
+
+// Inter-frame difference of the magnitude, highlighting flow for angiography:
+// magnitude -> magnitude. Holds the previous frame like `Align`.
+template <Floating T> class Angio : public UnaryStage<T> {
+public:
+  explicit Angio(const StageOptions &opts)
+      : UnaryStage<T>(Port::Magnitude, Port::Magnitude, opts) {}
+  void run(const StageContext<T> & /*ctx*/,
+           PipelineBuffers<T> &buf) override {
+    const auto &mag = buf.magnitude.at(this->m_in.name);
+    if (m_prevMat.size() == mag.size()) {
+      cv::absdiff(mag, m_prevMat, m_diff);
+    } else {
+      m_diff = cv::Mat_<T>::zeros(mag.size());
+    }
+    mag.copyTo(m_prevMat);
+    std::swap(buf.magnitude.at(this->m_out.name), m_diff);
+  }
+
+private:
+  cv::Mat_<T> m_prevMat;
+  cv::Mat_<T> m_diff;
+};
+
+} // namespace stages
+
+template <Floating T>
+using StageFactory =
+    std::function<std::unique_ptr<Stage<T>>(const StageOptions &)>;
+
+/**
+All stages that can be named in a pipeline config.
+To add a stage, implement `Stage<T>` and register it here.
+ */
+template <Floating T>
+[[nodiscard]] const std::map<std::string, StageFactory<T>> &stageRegistry() {
+  static const std::map<std::string, StageFactory<T>> registry{
+      {"recon",
+       [](const StageOptions &opts) {
+         return std::make_unique<stages::Recon<T>>(opts);
+       }},
+      {"fft",
+       [](const StageOptions &opts) {
+         return std::make_unique<stages::FFT<T>>(opts);
+       }},
+      {"logCompress",
+       [](const StageOptions &opts) {
+         return std::make_unique<stages::LogCompress<T>>(opts);
+       }},
+      {"distortion",
+       [](const StageOptions &opts) {
+         return std::make_unique<stages::Distortion<T>>(opts);
+       }},
+      {"align",
+       [](const StageOptions &opts) {
+         return std::make_unique<stages::Align<T>>(opts);
+       }},
+      {"rect",
+       [](const StageOptions &opts) {
+         return std::make_unique<stages::Rect<T>>(opts);
+       }},
+      {"median",
+       [](const StageOptions &opts) {
+         int ksize = 3;
+         if (const auto it = opts.find("ksize"); it != opts.end()) {
+           ksize = std::stoi(it->second);
+         }
+         if (ksize < 3 || ksize % 2 == 0) {
+           throw std::invalid_argument("ksize must be odd and >= 3");
+         }
+         return std::make_unique<stages::Median<T>>(opts, ksize);
+       }},
+      {"radial",
+       [](const StageOptions &opts) {
+         return std::make_unique<stages::Radial<T>>(opts);
+       }},
+      {"compound",
+       [](const StageOptions &opts) {
+         return std::make_unique<stages::Compound<T>>(opts);
+       }},
+      {"angio",
+       [](const StageOptions &opts) {
+         return std::make_unique<stages::Angio<T>>(opts);
+       }},
+  };
+  return registry;
+}
+
+template <Floating T> class Pipeline {
+public:
+  struct StageTiming {
+    std::string name;
+    float ms;
+  };
+
+  // Split spectrum recon, distortion correction and alignment, then the rect
+  // and radial images
+  static constexpr const char *defaultConfig = "recon\n"
+                                               "distortion\n"
+                                               "align\n"
+                                               "rect\n"
+                                               "radial\n";
+
+  static std::unique_ptr<Pipeline> makeDefault() {
+    auto pipeline = std::make_unique<Pipeline>();
+    std::istringstream iss(defaultConfig);
+    [[maybe_unused]] const auto err = pipeline->parse(iss);
+    assert(!err);
+    return pipeline;
+  }
+
+  // Build the pipeline from a config file. Returns an error message on
+  // failure.
+  [[nodiscard]] std::optional<std::string> loadConfig(const fs::path &path) {
+    std::ifstream ifs(path);
+    if (!ifs.is_open()) {
+      return fmt::format("Failed to open pipeline config {}", path.string());
+    }
+    return parse(ifs);
+  }
+
+  // Build the pipeline from a config stream. Returns an error message on
+  // failure.
+  [[nodiscard]] std::optional<std::string> parse(std::istream &is) {
+    std::vector<std::string> names;
+    std::vector<std::unique_ptr<Stage<T>>> stages;
+    const auto &registry = stageRegistry<T>();
+
+    std::string line;
+    int lineno = 0;
+    while (std::getline(is, line)) {
+      ++lineno;
+      std::istringstream ls(line);
+      std::string name;
+      if (!(ls >> name) || name.starts_with('#')) {
+        continue;
+      }
+
+      StageOptions opts;
+      std::string opt;
+      while (ls >> opt) {
+        const auto eq = opt.find('=');
+        if (eq == std::string::npos) {
+          return fmt::format("Line {}: expected key=value, got '{}'", lineno,
+                             opt);
+        }
+        opts[opt.substr(0, eq)] = opt.substr(eq + 1);
+      }
+
+      const auto it = registry.find(name);
+      if (it == registry.end()) {
+        return fmt::format("Line {}: unknown stage '{}'", lineno, name);
+      }
+
+      try {
+        stages.push_back(it->second(opts));
+      } catch (const std::exception &e) {
+        return fmt::format("Line {}: invalid options for stage '{}': {}",
+                           lineno, name, e.what());
+      }
+      names.push_back(name);
+    }
+
+    if (auto err = validate(names, stages)) {
+      return err;
+    }
+
+    m_names = std::move(names);
+    m_stages = std::move(stages);
+    m_buffers = {};
+    for (const auto &stage : m_stages) {
+      for (const auto &port : stage->outputs()) {
+        m_buffers.create(port);
+      }
+    }
+    buildLevels();
+    return std::nullopt;
+  }
+
+  /**
+  Run all stages on one frame.
+  After returning, `rect()` and `radial()` hold the result.
+   */
+  void run(const StageContext<T> &ctx, std::span<const uint16_t> fringe) {
+    m_buffers.fringe = fringe;
+    m_timings.resize(m_stages.size());
+
+    const auto runStage = [&](size_t i) {
+      TimeIt timeit;
+      m_stages[i]->run(ctx, m_buffers);
+      m_timings[i] = {m_names[i], timeit.get_ms()};
+    };
+
+    for (const auto &level : m_levels) {
+      if (level.size() == 1) {
+        runStage(level.front());
+      } else {
+        tbb::parallel_for(size_t{0}, level.size(),
+                          [&](size_t j) { runStage(level[j]); });
+      }
+    }
+  }
+
+  [[nodiscard]] auto buffers() const -> const PipelineBuffers<T> & {
+    return m_buffers;
+  }
+
+  // Main rect and radial images, for display
+  [[nodiscard]] const cv::Mat_<uint8_t> &rect() const {
+    return m_buffers.rect.at(MainBuffer);
+  }
+  [[nodiscard]] const cv::Mat_<uint8_t> &radial() const {
+    return m_buffers.radial.at(MainBuffer);
+  }
+
+  // Per-stage time of the last `run`, in config order
+  [[nodiscard]] auto timings() const -> const std::vector<StageTiming> & {
+    return m_timings;
+  }
+
+  [[nodiscard]] std::string describe() const {
+    std::string desc;
+    for (size_t l = 0; l < m_levels.size(); ++l) {
+      if (l != 0) {
+        desc += " -> ";
+      }
+      for (size_t j = 0; j < m_levels[l].size(); ++j) {
+        if (j != 0) {
+          desc += " | ";
+        }
+        desc += m_names[m_levels[l][j]];
+      }
+    }
+    return desc;
+  }
+
+private:
+  std::vector<std::string> m_names;
+  std::vector<std::unique_ptr<Stage<T>>> m_stages;
+  // Stage indices grouped by dependency level. Stages on one level run in
+  // parallel.
+  std::vector<std::vector<size_t>> m_levels;
+
+  PipelineBuffers<T> m_buffers;
+  std::vector<StageTiming> m_timings;
+
+  // Every input must be produced by an earlier stage, and the pipeline must
+  // produce the main rect and radial images for display.
+  static std::optional<std::string>
+  validate(const std::vector<std::string> &names,
+           const std::vector<std::unique_ptr<Stage<T>>> &stages) {
+    std::set<PortRef> available{{Port::Fringe, MainBuffer}};
+
+    for (size_t i = 0; i < stages.size(); ++i) {
+      for (const auto &port : stages[i]->inputs()) {
+        if (!available.contains(port)) {
+          return fmt::format("Stage '{}' needs {}, which no earlier stage "
+                             "produces",
+                             names[i], toString(port));
+        }
+      }
+      for (const auto &port : stages[i]->outputs()) {
+        available.insert(port);
+      }
+    }
+
+    for (const auto kind : {Port::Rect, Port::Radial}) {
+      const PortRef port{kind, MainBuffer};
+      if (!available.contains(port)) {
+        return fmt::format("Pipeline doesn't produce the {} image",
+                           toString(port));
+      }
+    }
+    return std::nullopt;
+  }
+
+  void buildLevels() {
+    const auto overlaps = [](const std::vector<PortRef> &a,
+                             const std::vector<PortRef> &b) {
+      return std::ranges::any_of(a, [&](const PortRef &p) {
+        return std::ranges::find(b, p) != b.end();
+      });
+    };
+
+    std::vector<size_t> level(m_stages.size(), 0);
+    for (size_t j = 0; j < m_stages.size(); ++j) {
+      const auto in_j = m_stages[j]->inputs();
+      const auto out_j = m_stages[j]->outputs();
+      for (size_t i = 0; i < j; ++i) {
+        const auto in_i = m_stages[i]->inputs();
+        const auto out_i = m_stages[i]->outputs();
+        if (overlaps(out_i, in_j) || overlaps(out_i, out_j) ||
+            overlaps(in_i, out_j)) {
+          level[j] = std::max(level[j], level[i] + 1);
+        }
+      }
+    }
+
+    m_levels.clear();
+    for (size_t j = 0; j < m_stages.size(); ++j) {
+      if (level[j] >= m_levels.size()) {
+        m_levels.resize(level[j] + 1);
+      }
+      m_levels[level[j]].push_back(j);
+    }
+  }
+};
+
+} // namespace OCT
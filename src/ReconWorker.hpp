@@ -5,14 +5,20 @@
 #include "ImageDisplay.hpp"
 #include "OCTData.hpp"
 #include "OCTRecon.hpp"
+#include "Pipeline.hpp"
 #include "RingBuffer.hpp"
 #include <QImage>
 #include <QObject>
 #include <QPixmap>
 #include <QtLogging>
 #include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
 #include <qdebug.h>
+#include <thread>
 #include <utility>
 
 namespace OCT {
@@ -34,8 +40,19 @@ public:
   explicit ReconWorker(std::shared_ptr<RingBuffer<OCTData<Float>>> buffer,
                        size_t ALineSize, ImageDisplay *imageDisplay)
       : m_ringBuffer(std::move(buffer)), ALineSize(ALineSize),
+        m_pipeline(Pipeline<Float>::makeDefault()),
         m_imageDisplay(imageDisplay) {}
 
+  // Called with every processed live frame, and its latency the first time
+  // the frame is processed. If it returns true, the frame was taken over
+  // (e.g. by the sweep display) and isn't displayed. Must be set before
+  // `start`.
+  using LiveFrameCallback = std::function<bool(
+      const OCTData<Float> &dat, std::optional<float> latencyMs)>;
+  void setLiveFrameCallback(LiveFrameCallback callback) {
+    m_liveFrameCallback = std::move(callback);
+  }
+
 Q_SIGNALS:
   void statusMessage(QString msg);
 
@@ -47,6 +64,10 @@ public Q_SLOTS:
   void setShouldStop(bool shouldStop) { this->shouldStop = shouldStop; }
 
   void setParams(OCTReconParams<Float> params) { m_params = params; }
+  void setPipeline(std::shared_ptr<Pipeline<Float>> pipeline) {
+    std::unique_lock<std::mutex> lock(m_pipelineMutex);
+    m_pipeline = std::move(pipeline);
+  }
   void setExportSettings(const ExportSettings &settings) {
     m_exportSettings = settings;
   }
@@ -57,7 +78,12 @@ public Q_SLOTS:
   void start() {
     assert(m_ringBuffer != nullptr);
 
-    const auto consumeFunc = [this](std::shared_ptr<OCTData<Float>> &dat) {
+    // Set when a frame is skipped, so the no block loop doesn't spin on the
+    // ring buffer's lock.
+    bool skipped = false;
+
+    const auto consumeFunc = [this, &skipped](
+                                 std::shared_ptr<OCTData<Float>> &dat) {
       try {
 
         if (m_calib == nullptr) {
@@ -69,26 +95,53 @@ public Q_SLOTS:
           return;
         }
 
+        // In no block mode the head frame is consumed again until the next
+        // one arrives. While live frames are taken over by the callback the
+        // result isn't displayed, so don't process it again.
+        const bool isLive = dat->acquiredAt != TimeIt::clock::time_point{};
+        if (isLive && m_lastTakenOver &&
+            dat->acquiredAt == m_lastAcquiredAt) {
+          skipped = true;
+          return;
+        }
+
+        std::shared_ptr<Pipeline<Float>> pipeline;
+        {
+          std::unique_lock<std::mutex> lock(m_pipelineMutex);
+          pipeline = m_pipeline;
+        }
+
         TimeIt timeit;
         float elapsedRecon{};
         {
           TimeIt timeitRecon;
-          dat->imgRect = reconBscan_splitSpectrum<Float>(*m_calib, dat->fringe,
-                                                         ALineSize, m_params);
+          const StageContext<Float> ctx{*m_calib, ALineSize, m_params};
+          pipeline->run(ctx, dat->fringe);
+          pipeline->rect().copyTo(dat->imgRect);
+          pipeline->radial().copyTo(dat->imgRadial);
           elapsedRecon = timeitRecon.get_ms();
         }
 
-        float elapsedRadial{};
-        {
-          TimeIt timeit;
-          makeRadialImage(dat->imgRect, dat->imgRadial, m_params.padTop);
-          elapsedRadial = timeit.get_ms();
-        }
-
         if (m_exportSettings.saveImages) {
           exportImages(*dat);
         }
 
+        // Live frames: latency from the DAQ to the display, measured once
+        // per frame (in no block mode the same frame may be processed again).
+        std::optional<float> latency;
+        if (isLive && dat->acquiredAt != m_lastAcquiredAt) {
+          m_lastAcquiredAt = dat->acquiredAt;
+          latency = std::chrono::duration<float, std::milli>(
+                        TimeIt::clock::now() - dat->acquiredAt)
+                        .count();
+        }
+
+        m_lastTakenOver = isLive && m_liveFrameCallback &&
+                          m_liveFrameCallback(*dat, latency);
+        if (m_lastTakenOver) {
+          return;
+        }
+
         makeCombinedImage(*dat);
 
         // Update image display
@@ -100,9 +153,16 @@ public Q_SLOTS:
 
         // Status message
         const auto elapsedTotal = timeit.get_ms();
-        const auto msg =
-            fmt::format("Loaded frame {}, recon {:.3f} ms, total {:.3f} ms",
-                        dat->i, elapsedRecon, elapsedTotal);
+        std::string stageTimings;
+        for (const auto &[name, ms] : pipeline->timings()) {
+          stageTimings += fmt::format(", {} {:.3f}", name, ms);
+        }
+        auto msg = fmt::format(
+            "Loaded frame {}, recon {:.3f} ms{}, total {:.3f} ms", dat->i,
+            elapsedRecon, stageTimings, elapsedTotal);
+        if (latency) {
+          msg += fmt::format(", latency {:.1f} ms", *latency);
+        }
         Q_EMIT statusMessage(QString::fromStdString(msg));
       } catch (std::exception &e) {
         qDebug() << "Exception in ReconWorker consumeFunc" << e.what();
@@ -111,7 +171,11 @@ public Q_SLOTS:
 
     while (!shouldStop) {
       if (noBlockMode) {
+        skipped = false;
         m_ringBuffer->consume_head(consumeFunc);
+        if (skipped) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
       } else {
         m_ringBuffer->consume(consumeFunc);
       }
@@ -158,9 +222,16 @@ private:
   std::shared_ptr<Calibration<Float>> m_calib;
   size_t ALineSize;
   OCTReconParams<Float> m_params;
+  std::shared_ptr<Pipeline<Float>> m_pipeline;
+  std::mutex m_pipelineMutex;
   ExportSettings m_exportSettings;
 
   ImageDisplay *m_imageDisplay;
+
+  LiveFrameCallback m_liveFrameCallback;
+  TimeIt::clock::time_point m_lastAcquiredAt{};
+  // The last live frame was taken over by the callback
+  bool m_lastTakenOver{false};
 };
 
 } // namespace OCT
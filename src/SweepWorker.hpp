@@ -0,0 +1,330 @@
+#pragma once
+
+#include "Calibration.hpp"
+#include "Common.hpp"
+#include "ImageDisplay.hpp"
+#include "OCTData.hpp"
+#include "OCTRecon.hpp"
+#include "ReconWorker.hpp"
+#include "RingBuffer.hpp"
+#include "phasecorr.hpp"
+#include "timeit.hpp"
+#include <QObject>
+#include <QPixmap>
+#include <QtLogging>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fmt/format.h>
+#include <memory>
+#include <mutex>
+#include <qdebug.h>
+#include <utility>
+#include <vector>
+
+namespace OCT {
+
+/**
+Progressive ("radar sweep") display for live acquisition.
+
+Reconstructs each sub-frame chunk produced by the DAQ as soon as it arrives
+and redraws only the sectors of the radial image it covers, instead of
+waiting for the full frame.
+
+Distortion correction and alignment need the whole frame, so the sweep is
+drawn over the last frame fully processed by the `ReconWorker`, which hands it
+over with `setBaseImage`. The raw chunks are placed at the rotation offset
+measured between the latest corrected frame and the raw sweep of the same
+frame.
+
+The combined display image is kept between chunks. The whole image is shown
+once per rotation, when the corrected frame is drawn, and every other chunk
+only hands the display the regions it changed.
+ */
+class SweepWorker : public QObject {
+  Q_OBJECT;
+
+public:
+  // Number of angular sectors of the radial image. Finer than the chunks, so
+  // a chunk only redraws the wedge it covers.
+  static constexpr int Sectors = 64;
+
+  explicit SweepWorker(std::shared_ptr<RingBuffer<OCTChunk<Float>>> buffer,
+                       size_t ALineSize, ImageDisplay *imageDisplay)
+      : m_chunkBuffer(std::move(buffer)), ALineSize(ALineSize),
+        m_imageDisplay(imageDisplay) {}
+
+  // When enabled, the `ReconWorker` hands live frames to `setBaseImage`
+  // instead of displaying them.
+  void setEnabled(bool enabled) { m_enabled = enabled; }
+  [[nodiscard]] bool isEnabled() const { return m_enabled; }
+
+  // Thread safe. Processed rect image of live frame `frameIdx`, and its
+  // latency from the DAQ to the display.
+  void setBaseImage(const cv::Mat_<uint8_t> &rect, size_t frameIdx,
+                    float latencyMs) {
+    std::unique_lock<std::mutex> lock(m_baseMutex);
+    rect.copyTo(m_pendingBase.rect);
+    m_pendingBase.frameIdx = frameIdx;
+    m_pendingBase.latencyMs = latencyMs;
+    m_pendingBase.valid = true;
+  }
+
+Q_SIGNALS:
+  void statusMessage(QString msg);
+
+public Q_SLOTS:
+  void setCalibration(std::shared_ptr<Calibration<Float>> calibration) {
+    this->m_calib = std::move(calibration);
+  }
+  void setALineSize(size_t ALineSize) { this->ALineSize = ALineSize; }
+  void setShouldStop(bool shouldStop) { this->shouldStop = shouldStop; }
+
+  void setParams(OCTReconParams<Float> params) { m_params = params; }
+
+  void start() {
+    assert(m_chunkBuffer != nullptr);
+
+    bool haveChunk = false;
+    const auto consumeFunc = [&](std::shared_ptr<OCTChunk<Float>> &chunk) {
+      // Take the chunk out of the ring buffer, so the DAQ isn't blocked on
+      // its lock during recon. The slot keeps our previous fringe buffer.
+      if (chunk != nullptr) {
+        std::swap(*chunk, m_chunk);
+        haveChunk = true;
+      }
+    };
+
+    while (!shouldStop) {
+      haveChunk = false;
+      m_chunkBuffer->consume(consumeFunc);
+      if (!haveChunk || m_calib == nullptr || !m_enabled) {
+        continue;
+      }
+
+      try {
+        processChunk(m_chunk);
+      } catch (std::exception &e) {
+        qDebug() << "Exception in SweepWorker processChunk" << e.what();
+      }
+    }
+  }
+
+private:
+  struct BaseImage {
+    cv::Mat_<uint8_t> rect;
+    size_t frameIdx{};
+    float latencyMs{};
+    bool valid{false};
+  };
+
+  // Raw sweep of a completed frame, one A-line per row, and the rotation
+  // offset it was drawn with.
+  struct RawSweep {
+    cv::Mat_<uint8_t> polar;
+    size_t frameIdx{};
+    int shift{};
+    bool valid{false};
+  };
+
+  std::atomic<bool> shouldStop{false};
+  std::atomic<bool> m_enabled{false};
+
+  std::shared_ptr<RingBuffer<OCTChunk<Float>>> m_chunkBuffer;
+  std::shared_ptr<Calibration<Float>> m_calib;
+  size_t ALineSize;
+  OCTReconParams<Float> m_params;
+
+  ImageDisplay *m_imageDisplay;
+
+  // Frame handed over by the ReconWorker, applied at the next rotation
+  std::mutex m_baseMutex;
+  BaseImage m_pendingBase;
+  float m_frameLatencyMs{};
+
+  // Polar image (one A-line per row, `padTop + imageDepth` columns), and the
+  // display image drawn from it: the radial image on the left, the rect
+  // image (transposed polar) on the top right.
+  SectorPolarMap m_map;
+  cv::Mat_<uint8_t> m_polar;
+  cv::Mat_<uint8_t> m_combined;
+  // Radial part of `m_combined`
+  cv::Mat_<uint8_t> m_radial;
+  // Regions of `m_combined` changed since the display was last updated
+  std::vector<cv::Rect> m_dirty;
+  // Rotation offset (rows) of the raw sweep
+  int m_shift{};
+
+  // Raw sweeps of the last few frames, by frame index, to measure the
+  // rotation offset against their corrected frames. A corrected frame is
+  // handed over a full recon after its last chunk, and applied at the start
+  // of a later frame.
+  static constexpr size_t RawHistory = 4;
+  std::array<RawSweep, RawHistory> m_rawSweeps;
+
+  // Chunk buffers
+  OCTChunk<Float> m_chunk;
+  cv::Mat_<Float> m_mag;
+  cv::Mat_<uint8_t> m_mag8;
+
+  // Chunk latency of the current frame
+  float m_latencySum{};
+  int m_latencyCount{};
+
+  void processChunk(const OCTChunk<Float> &chunk) {
+    const auto params = m_params;
+    const int imageDepth = params.imageDepth;
+    const int padTop = params.padTop;
+    const int nRows =
+        static_cast<int>(getTheoreticalALines(chunk.linesPerFrame));
+
+    if (!m_map.matches(nRows, imageDepth, padTop)) {
+      m_map = SectorPolarMap(nRows, imageDepth, padTop, Sectors);
+      m_polar = cv::Mat_<uint8_t>(nRows, padTop + imageDepth, uint8_t{0});
+      const auto radialSize = m_map.radialSize();
+      m_combined = cv::Mat_<uint8_t>(radialSize.height,
+                                     radialSize.width + nRows, uint8_t{0});
+      m_radial = m_combined(
+          cv::Rect(0, 0, radialSize.width, radialSize.height));
+      m_shift = 0;
+      m_rawSweeps = {};
+    }
+
+    if (chunk.chunkIdx == 0) {
+      applyPendingBase();
+    }
+
+    // Recon the chunk and copy it to its rows of the polar image.
+    reconLogMagnitude<Float>(*m_calib, chunk.fringe, ALineSize, params, m_mag);
+    m_mag.convertTo(m_mag8, CV_8U);
+
+    const auto linesPerChunk = chunk.linesPerFrame / chunk.chunksPerFrame;
+    const auto line0 = static_cast<int>(chunk.chunkIdx * linesPerChunk);
+    // A-lines past one rotation (cropped by distortion correction) are
+    // dropped.
+    const int nLines = std::min(m_mag8.rows, nRows - line0);
+    if (nLines > 0) {
+      const int row0 = (line0 + m_shift) % nRows;
+      const int n1 = std::min(nLines, nRows - row0);
+      m_mag8.rowRange(0, n1).copyTo(
+          m_polar(cv::Rect(padTop, row0, imageDepth, n1)));
+      drawRows(row0, row0 + n1);
+
+      // Wrap around
+      if (n1 < nLines) {
+        m_mag8.rowRange(n1, nLines)
+            .copyTo(m_polar(cv::Rect(padTop, 0, imageDepth, nLines - n1)));
+        drawRows(0, nLines - n1);
+      }
+    }
+
+    // Update image display. The first chunk of a rotation follows the
+    // corrected frame, which changed the whole image.
+    if (chunk.chunkIdx == 0) {
+      QMetaObject::invokeMethod(m_imageDisplay, &ImageDisplay::imshow,
+                                matToQPixmap(m_combined));
+    } else {
+      for (const auto &roi : m_dirty) {
+        if (!roi.empty()) {
+          QMetaObject::invokeMethod(m_imageDisplay,
+                                    &ImageDisplay::imshowRegion,
+                                    matToQPixmap(m_combined(roi)),
+                                    QPoint(roi.x, roi.y));
+        }
+      }
+    }
+    m_dirty.clear();
+
+    QMetaObject::invokeMethod(m_imageDisplay->overlay(),
+                              &ImageOverlay::setProgress,
+                              static_cast<int>(chunk.frameIdx), -1);
+
+    m_latencySum += std::chrono::duration<float, std::milli>(
+                        TimeIt::clock::now() - chunk.acquiredAt)
+                        .count();
+    m_latencyCount++;
+
+    if (chunk.chunkIdx + 1 == chunk.chunksPerFrame) {
+      auto &raw = m_rawSweeps[chunk.frameIdx % RawHistory];
+      m_polar.colRange(padTop, padTop + imageDepth).copyTo(raw.polar);
+      raw.frameIdx = chunk.frameIdx;
+      raw.shift = m_shift;
+      raw.valid = true;
+      reportLatency(chunk);
+    }
+  }
+
+  // Draw the pending corrected frame (if any) as the background of the sweep
+  // and update the rotation offset.
+  void applyPendingBase() {
+    BaseImage base;
+    {
+      std::unique_lock<std::mutex> lock(m_baseMutex);
+      if (!m_pendingBase.valid) {
+        return;
+      }
+      std::swap(base, m_pendingBase);
+    }
+    m_frameLatencyMs = base.latencyMs;
+
+    // Rect is (imageDepth, nRows). Skip if the pipeline produced another size.
+    const int padTop = m_map.padTop();
+    const int imageDepth = m_map.cols() - padTop;
+    if (base.rect.rows != imageDepth || base.rect.cols != m_map.rows()) {
+      return;
+    }
+
+    // Compare with the raw sweep of the same frame. Same convention as
+    // `alignBscan`: shifting the raw sweep's columns by `offset` aligns it to
+    // the corrected frame.
+    const auto &raw = m_rawSweeps[base.frameIdx % RawHistory];
+    if (raw.valid && raw.frameIdx == base.frameIdx) {
+      cv::Mat_<float> ref;
+      cv::Mat_<float> rawRect;
+      base.rect.convertTo(ref, CV_32F);
+      cv::Mat(raw.polar.t()).convertTo(rawRect, CV_32F);
+      const int offset =
+          static_cast<int>(std::round(cvMod::phaseCorrelate(ref, rawRect).x));
+      const int nRows = m_map.rows();
+      m_shift = ((raw.shift - offset) % nRows + nRows) % nRows;
+    }
+
+    cv::Mat dst = m_polar.colRange(padTop, padTop + imageDepth);
+    cv::transpose(base.rect, dst);
+    drawRows(0, m_map.rows());
+  }
+
+  // Redraw polar rows [row0, row1) in the rect and radial parts of the
+  // display image.
+  void drawRows(int row0, int row1) {
+    if (row1 <= row0) {
+      return;
+    }
+    const int padTop = m_map.padTop();
+    const int imageDepth = m_map.cols() - padTop;
+    const cv::Rect rectRoi(m_radial.cols + row0, 0, row1 - row0, imageDepth);
+    cv::Mat dst = m_combined(rectRoi);
+    cv::transpose(m_polar(cv::Rect(padTop, row0, imageDepth, row1 - row0)),
+                  dst);
+    m_dirty.push_back(rectRoi);
+    m_dirty.push_back(m_map.update(m_polar, m_radial, row0, row1));
+  }
+
+  void reportLatency(const OCTChunk<Float> &chunk) {
+    const float sweepLatency =
+        m_latencyCount > 0 ? m_latencySum / static_cast<float>(m_latencyCount)
+                           : 0.0F;
+    m_latencySum = 0;
+    m_latencyCount = 0;
+
+    const auto msg = fmt::format(
+        "Sweep frame {}: {} chunks, display latency {:.1f} ms per chunk vs "
+        "{:.1f} ms per full frame",
+        chunk.frameIdx, chunk.chunksPerFrame, sweepLatency, m_frameLatencyMs);
+    qInfo("%s", msg.c_str());
+    Q_EMIT statusMessage(QString::fromStdString(msg));
+  }
+};
+
+} // namespace OCT
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "Common.hpp"
+#include <cassert>
+#include <fftconv/fftw.hpp>
+#include <fftw3.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// NOLINTBEGIN(*-reinterpret-cast)
+
+namespace OCT {
+
+namespace detail {
+
+template <Floating T> struct FFTWTypes;
+
+template <> struct FFTWTypes<float> {
+  using Plan = fftwf_plan;
+  using Complex = fftwf_complex;
+  static void *alloc(size_t n) { return fftwf_malloc(n); }
+  static void dealloc(void *p) { fftwf_free(p); }
+  static void destroy(Plan plan) { fftwf_destroy_plan(plan); }
+  static Plan planManyR2C(int n, int howmany, float *in, int istride,
+                          int idist, Complex *out, int ostride, int odist) {
+    return fftwf_plan_many_dft_r2c(1, &n, howmany, in, nullptr, istride, idist,
+                                   out, nullptr, ostride, odist,
+                                   FFTW_ESTIMATE);
+  }
+  static void executeR2C(Plan plan, float *in, Complex *out) {
+    fftwf_execute_dft_r2c(plan, in, out);
+  }
+};
+
+template <> struct FFTWTypes<double> {
+  using Plan = fftw_plan;
+  using Complex = fftw_complex;
+  static void *alloc(size_t n) { return fftw_malloc(n); }
+  static void dealloc(void *p) { fftw_free(p); }
+  static void destroy(Plan plan) { fftw_destroy_plan(plan); }
+  static Plan planManyR2C(int n, int howmany, double *in, int istride,
+                          int idist, Complex *out, int ostride, int odist) {
+    return fftw_plan_many_dft_r2c(1, &n, howmany, in, nullptr, istride, idist,
+                                  out, nullptr, ostride, odist, FFTW_ESTIMATE);
+  }
+  static void executeR2C(Plan plan, double *in, Complex *out) {
+    fftw_execute_dft_r2c(plan, in, out);
+  }
+};
+
+} // namespace detail
+
+/**
+Buffers for `EngineR2CBatched`, allocated with fftw_malloc so every buffer has
+the alignment the batched plan was created with.
+
+`in` holds `n * howmany` interleaved real samples.
+`out` holds `howmany` spectra of `n` complex values each (only the first
+`n / 2 + 1` are written by the r2c transform).
+ */
+template <Floating T> struct R2CBatchedBuffer {
+  using Types = detail::FFTWTypes<T>;
+
+  T *in;
+  fftw::Complex<T> *out;
+
+  R2CBatchedBuffer(size_t n, size_t howmany)
+      : in(static_cast<T *>(Types::alloc(n * howmany * sizeof(T)))),
+        out(static_cast<fftw::Complex<T> *>(
+            Types::alloc(n * howmany * sizeof(fftw::Complex<T>)))) {}
+
+  R2CBatchedBuffer(const R2CBatchedBuffer &) = delete;
+  R2CBatchedBuffer(R2CBatchedBuffer &&) = delete;
+  R2CBatchedBuffer &operator=(const R2CBatchedBuffer &) = delete;
+  R2CBatchedBuffer &operator=(R2CBatchedBuffer &&) = delete;
+
+  ~R2CBatchedBuffer() {
+    Types::dealloc(in);
+    Types::dealloc(out);
+  }
+};
+
+/**
+Batched 1D real-to-complex FFT of `howmany` signals of length `n`.
+
+The input is interleaved: sample `i` of signal `j` is at `in[i * howmany + j]`,
+which is the layout produced by `preprocessLockstep`.
+The spectrum of signal `j` is contiguous and starts at `out[j * n]`.
+
+Plans are cached per (n, howmany). `forward` uses the new-array execute
+interface, so one engine can be shared by all threads as long as the buffers
+come from `R2CBatchedBuffer`.
+ */
+template <Floating T> class EngineR2CBatched {
+public:
+  using Types = detail::FFTWTypes<T>;
+
+  EngineR2CBatched(size_t n, size_t howmany) : n(n), howmany(howmany) {
+    // Plan with scratch buffers. FFTW_ESTIMATE doesn't touch the arrays.
+    R2CBatchedBuffer<T> buf(n, howmany);
+    const auto ni = static_cast<int>(n);
+    const auto howmanyi = static_cast<int>(howmany);
+    plan = Types::planManyR2C(
+        ni, howmanyi, buf.in, howmanyi, 1,
+        reinterpret_cast<typename Types::Complex *>(buf.out), 1, ni);
+    assert(plan != nullptr);
+  }
+
+  EngineR2CBatched(const EngineR2CBatched &) = delete;
+  EngineR2CBatched(EngineR2CBatched &&) = delete;
+  EngineR2CBatched &operator=(const EngineR2CBatched &) = delete;
+  EngineR2CBatched &operator=(EngineR2CBatched &&) = delete;
+
+  ~EngineR2CBatched() { Types::destroy(plan); }
+
+  static EngineR2CBatched &get(size_t n, size_t howmany) {
+    // Guards the cache. Planning itself is serialized by FFTW, made thread
+    // safe in main() with fftw_make_planner_thread_safe.
+    static std::mutex mutex;
+    static std::map<std::pair<size_t, size_t>,
+                    std::unique_ptr<EngineR2CBatched>>
+        cache;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    auto &engine = cache[{n, howmany}];
+    if (engine == nullptr) {
+      engine = std::make_unique<EngineR2CBatched>(n, howmany);
+    }
+    return *engine;
+  }
+
+  void forward(T *in, fftw::Complex<T> *out) const {
+    Types::executeR2C(plan, in,
+                      reinterpret_cast<typename Types::Complex *>(out));
+  }
+
+  [[nodiscard]] size_t size() const { return n; }
+  [[nodiscard]] size_t batch() const { return howmany; }
+
+private:
+  size_t n;
+  size_t howmany;
+  typename Types::Plan plan;
+};
+
+} // namespace OCT
+
+// NOLINTEND(*-reinterpret-cast)
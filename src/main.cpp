@@ -1,8 +1,15 @@
 #include "MainWindow.hpp"
 #include <QApplication>
+#include <fftw3.h>
 #include <fmt/core.h>
 
 int main(int argc, char *argv[]) {
+  // FFTW plans are created on demand by the recon, sweep and thumbnail
+  // threads, through both fftconv's engines and OCT::EngineR2CBatched. The
+  // planner is global, so make it thread safe before any thread starts.
+  fftw_make_planner_thread_safe();
+  fftwf_make_planner_thread_safe();
+
   QApplication::setStyle("Fusion");
   QApplication app(argc, argv);
 